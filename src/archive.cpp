@@ -0,0 +1,124 @@
+#include "archive.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_NAME 56
+#define ARCHIVE_ALIGN 16
+
+struct ArchiveHeader
+{
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t count;
+    std::uint32_t reserved;
+};
+
+struct ArchiveEntry
+{
+    char name[ARCHIVE_NAME];
+    std::uint32_t offset;
+    std::uint32_t size;
+};
+
+static const ArchiveEntry *entries(const MappedFile &file) {
+    return reinterpret_cast<const ArchiveEntry *>(file.data() + sizeof(ArchiveHeader));
+}
+
+bool AssetArchive::open(const std::string &path) {
+    count = 0;
+    if (!file.open(path) || file.size() < sizeof(ArchiveHeader)) return false;
+
+    ArchiveHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, "SPAK", 4) != 0 || header.version != ARCHIVE_VERSION) return false;
+    if (file.size() < sizeof(header) + std::size_t(header.count) * sizeof(ArchiveEntry)) return false;
+    for (std::uint32_t i = 0; i < header.count; i++) {
+        const ArchiveEntry &entry = entries(file)[i];
+        if (std::size_t(entry.offset) + entry.size > file.size()) return false;
+    }
+    count = header.count;
+    return true;
+}
+
+const unsigned char *AssetArchive::find(const std::string &name, std::size_t &size) const {
+    if (name.size() >= ARCHIVE_NAME) return nullptr;
+
+    // The index is sorted, so look names up in place without building a map
+    const ArchiveEntry *begin = entries(file);
+    const ArchiveEntry *end = begin + count;
+    const ArchiveEntry *entry = std::lower_bound(begin, end, name, [](const ArchiveEntry &e, const std::string &n) {
+        return std::strncmp(e.name, n.c_str(), ARCHIVE_NAME) < 0;
+    });
+    if (entry == end || std::strncmp(entry->name, name.c_str(), ARCHIVE_NAME) != 0) return nullptr;
+    size = entry->size;
+    return file.data() + entry->offset;
+}
+
+std::string besideProgram(const char *program, const char *name) {
+    return (std::filesystem::path(program).parent_path() / name).string();
+}
+
+bool openAssetArchive(AssetArchive &archive, const char *program) {
+    return archive.open(besideProgram(program, ASSET_ARCHIVE)) || archive.open(ASSET_ARCHIVE);
+}
+
+int runPackAssets(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: sambar --pack-assets <archive>" << std::endl;
+        return -1;
+    }
+
+    // Images, the font, level files and stacks, by the same relative paths the game opens them with
+    std::vector<std::string> names;
+    for (const char *dir : {"img", "levels"}) {
+        for (const auto &item : std::filesystem::directory_iterator(dir)) {
+            std::string extension = item.path().extension().string();
+            if (item.is_regular_file() && (extension == ".png" || extension == ".ttf" || extension == ".lvl"
+                                        || extension == ".stk")) {
+                names.push_back(std::string(dir) + "/" + item.path().filename().string());
+            }
+        }
+    }
+    std::sort(names.begin(), names.end());
+
+    ArchiveHeader header{};
+    std::memcpy(header.magic, "SPAK", 4);
+    header.version = ARCHIVE_VERSION;
+    header.count = names.size();
+    std::vector<ArchiveEntry> index(names.size());
+    std::vector<std::vector<char>> contents(names.size());
+    std::size_t offset = sizeof(header) + names.size() * sizeof(ArchiveEntry);
+    for (std::size_t i = 0; i < names.size(); i++) {
+        if (names[i].size() >= ARCHIVE_NAME) {
+            std::cerr << "name too long to pack: " << names[i] << std::endl;
+            return -1;
+        }
+        std::ifstream in(names[i], std::ios::binary);
+        contents[i].assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        offset = (offset + ARCHIVE_ALIGN - 1) / ARCHIVE_ALIGN * ARCHIVE_ALIGN;
+        std::memcpy(index[i].name, names[i].c_str(), names[i].size());
+        index[i].offset = offset;
+        index[i].size = contents[i].size();
+        offset += contents[i].size();
+    }
+
+    std::ofstream out(argv[2], std::ios::binary);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(ArchiveEntry));
+    for (std::size_t i = 0; i < names.size(); i++) {
+        while (static_cast<std::size_t>(out.tellp()) < index[i].offset) out.put(0);
+        out.write(contents[i].data(), contents[i].size());
+    }
+    if (!out) {
+        std::cerr << "cannot write archive " << argv[2] << std::endl;
+        return -1;
+    }
+    std::cout << "packed " << names.size() << " files into " << argv[2] << std::endl;
+    return 0;
+}
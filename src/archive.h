@@ -0,0 +1,38 @@
+#ifndef SAMBAR_ARCHIVE_H
+#define SAMBAR_ARCHIVE_H
+
+#include "mapped_file.h"
+#include <cstddef>
+#include <string>
+
+// Name of the packed assets, which the build writes next to the game
+#define ASSET_ARCHIVE "assets.pak"
+
+// All the game's files packed into one, memory-mapped so each asset is read in place:
+//   "SPAK", u32 version, u32 file count, u32 0,
+//   then per file, sorted by name: char[56] name, u32 offset, u32 size,
+//   then the file contents, each starting on a 16-byte boundary
+class AssetArchive
+{
+public:
+    bool open(const std::string &path);
+    bool isOpen() const { return count != 0; }
+    // The packed bytes of a file by its path, such as "img/splash.png", nullptr if it isn't packed.
+    // They stay valid for the life of the archive
+    const unsigned char *find(const std::string &name, std::size_t &size) const;
+
+private:
+    MappedFile file;
+    std::size_t count = 0;
+};
+
+// The path of a file in the directory holding program, the game's argv[0]
+std::string besideProgram(const char *program, const char *name);
+// Open the archive the build wrote next to program, the game's argv[0], or failing that the one
+// in the working directory
+bool openAssetArchive(AssetArchive &archive, const char *program);
+
+// sambar --pack-assets <archive>: pack img/ and levels/ from the working directory
+int runPackAssets(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,240 @@
+#include "assets.h"
+#include "mapped_file.h"
+#include "textures.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#define IMAGE_CACHE_VERSION 2
+
+struct CacheHeader
+{
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t count;
+    std::uint32_t reserved;
+};
+
+struct CacheEntry
+{
+    std::uint64_t hash;
+    std::int32_t area[4];
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t offset;
+    std::uint32_t reserved;
+};
+
+struct ImageCache::Blob
+{
+    unsigned width = 0;
+    unsigned height = 0;
+    const std::uint8_t *pixels = nullptr;
+};
+
+static const CacheEntry *entries(const MappedFile &file) {
+    return reinterpret_cast<const CacheEntry *>(file.data() + sizeof(CacheHeader));
+}
+
+bool loadFont(const AssetArchive *archive, const std::string &path, sf::Font &font) {
+    std::size_t size;
+    const unsigned char *packed = archive ? archive->find(path, size) : nullptr;
+    return packed ? font.loadFromMemory(packed, size) : font.loadFromFile(path);
+}
+
+static long microsecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+ImageCache::ImageCache(const AssetArchive *archive, const std::string &path) : archive(archive), path(path) {
+    open();
+}
+
+// Map the cache file, treating one that is missing or doesn't hold together as empty
+void ImageCache::open() {
+    count = 0;
+    used.clear();
+    added.clear();
+    if (!file.open(path) || file.size() < sizeof(CacheHeader)) return;
+
+    CacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, "SIMG", 4) != 0 || header.version != IMAGE_CACHE_VERSION) return;
+    if (file.size() < sizeof(header) + std::size_t(header.count) * sizeof(CacheEntry)) return;
+    for (std::uint32_t i = 0; i < header.count; i++) {
+        const CacheEntry &entry = entries(file)[i];
+        if (entry.offset % 4 != 0
+            || std::uint64_t(entry.offset) + std::uint64_t(entry.width) * entry.height * 4 > file.size()) {
+            return;
+        }
+    }
+    count = header.count;
+    used.assign(count, false);
+}
+
+// Find the cached pixels for path and area, or decode the PNG into decoded and keep it to save.
+// On a hit blob.pixels is set, false if the image can't be loaded at all
+bool ImageCache::fetch(const std::string &path, const sf::IntRect &area, Blob &blob, sf::Image &decoded) const {
+    auto start = std::chrono::steady_clock::now();
+    MappedFile source;
+    std::size_t size;
+    const unsigned char *bytes = archive ? archive->find(path, size) : nullptr;
+    if (!bytes) {
+        if (!source.open(path)) return false;
+        bytes = source.data();
+        size = source.size();
+    }
+
+    // FNV-1a over the PNG, so any edit to it misses the old pixels
+    std::uint64_t hash = 14695981039346656037u;
+    for (std::size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211u;
+    }
+
+    // A handful of images, so the index is searched in place
+    for (std::size_t i = 0; i < count; i++) {
+        const CacheEntry &entry = entries(file)[i];
+        if (entry.hash == hash && entry.area[0] == area.left && entry.area[1] == area.top
+            && entry.area[2] == area.width && entry.area[3] == area.height) {
+            blob.width = entry.width;
+            blob.height = entry.height;
+            blob.pixels = file.data() + entry.offset;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                used[i] = true;
+            }
+            counters.hits++;
+            counters.hit_us += microsecondsSince(start);
+            return true;
+        }
+    }
+
+    sf::Image full;
+    if (!full.loadFromMemory(bytes, size)) return false;
+    sf::IntRect clipped = clipArea(area, full.getSize());
+    if (clipped.width <= 0 || clipped.height <= 0) return false;
+    decoded.create(clipped.width, clipped.height);
+    decoded.copy(full, 0, 0, clipped);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        added.push_back(Decoded{hash, area, decoded});
+    }
+
+    counters.decoded++;
+    counters.decode_us += microsecondsSince(start);
+    return true;
+}
+
+bool ImageCache::load(const std::string &path, const sf::IntRect &area, sf::Image &image) const {
+    Blob blob;
+    if (!fetch(path, area, blob, image)) return false;
+    if (blob.pixels) image.create(blob.width, blob.height, blob.pixels);
+    return true;
+}
+
+bool ImageCache::loadTexture(const std::string &path, const sf::IntRect &area, sf::Texture &texture) const {
+    Blob blob;
+    sf::Image decoded;
+    if (!fetch(path, area, blob, decoded)) return false;
+    if (!blob.pixels) return texture.loadFromImage(decoded);
+    if (!texture.create(blob.width, blob.height)) return false;
+    texture.update(blob.pixels);
+    return true;
+}
+
+bool ImageCache::save() {
+    if (added.empty()) return true;
+
+    // The images asked for out of the old file, then the new ones, pixels after the whole index
+    std::vector<CacheEntry> index;
+    std::vector<const std::uint8_t *> pixels;
+    for (std::size_t i = 0; i < count; i++) {
+        if (!used[i]) continue;
+        index.push_back(entries(file)[i]);
+        pixels.push_back(file.data() + index.back().offset);
+    }
+    for (const auto &image : added) {
+        CacheEntry entry{};
+        entry.hash = image.hash;
+        entry.area[0] = image.area.left;
+        entry.area[1] = image.area.top;
+        entry.area[2] = image.area.width;
+        entry.area[3] = image.area.height;
+        entry.width = image.image.getSize().x;
+        entry.height = image.image.getSize().y;
+        index.push_back(entry);
+        pixels.push_back(image.image.getPixelsPtr());
+    }
+    CacheHeader header{};
+    std::memcpy(header.magic, "SIMG", 4);
+    header.version = IMAGE_CACHE_VERSION;
+    header.count = index.size();
+    std::size_t offset = sizeof(header) + index.size() * sizeof(CacheEntry);
+    for (auto &entry : index) {
+        entry.offset = offset;
+        offset += std::size_t(entry.width) * entry.height * 4;
+    }
+
+    // Written under a name of its own then renamed, so no reader ever sees half a file
+    std::string temp_path = path + ".new";
+    {
+        std::ofstream out(temp_path, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(CacheEntry));
+        for (std::size_t i = 0; i < index.size(); i++) {
+            out.write(reinterpret_cast<const char *>(pixels[i]), std::size_t(index[i].width) * index[i].height * 4);
+        }
+        if (!out) {
+            out.close();
+            std::error_code error;
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+    }
+    // Unmapped first, since a mapped file can't be replaced everywhere
+    file.close();
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    bool renamed = !error;
+    if (!renamed) std::filesystem::remove(temp_path, error);
+    open();
+    return renamed;
+}
+
+ImageLoader::ImageLoader(const std::vector<ImageRequest> &requests, const ImageCache &cache, unsigned threads)
+    : count(requests.size()), slots(new Slot[requests.size()]) {
+    for (std::size_t i = 0; i < count; i++) {
+        slots[i].request = requests[i];
+    }
+
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<std::size_t>(threads, count);
+    // Workers pull files off a shared counter, in order, so the first requested are ready first
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([this, &cache]() {
+            for (std::size_t i = next++; i < count; i = next++) {
+                slots[i].loaded = cache.load(slots[i].request.path, slots[i].request.area, slots[i].image);
+                slots[i].done.store(true, std::memory_order_release);
+            }
+        });
+    }
+}
+
+ImageLoader::~ImageLoader() {
+    // Skip whatever hasn't been started, then wait for the files being decoded
+    next = count;
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+bool ImageLoader::ready(std::size_t i) const {
+    return slots[i].done.load(std::memory_order_acquire);
+}
+
+const sf::Image *ImageLoader::image(std::size_t i) const {
+    return slots[i].loaded ? &slots[i].image : nullptr;
+}
@@ -0,0 +1,114 @@
+#ifndef SAMBAR_ASSETS_H
+#define SAMBAR_ASSETS_H
+
+#include "archive.h"
+#include <SFML/Graphics.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Where decoded images are kept between runs, in the directory holding the game
+#define IMAGE_CACHE "images.cache"
+
+// Load from the archive when it has the file, straight from its mapped bytes, or else from disk.
+// The font keeps reading the archive, so it must outlive the font
+bool loadFont(const AssetArchive *archive, const std::string &path, sf::Font &font);
+
+// Decoded, cropped RGBA copies of images, so a PNG is only decoded again once it changes.
+// They all live in one memory-mapped file, each keyed by a hash of the PNG bytes and the area
+// cropped from it:
+//   "SIMG", u32 version, u32 image count, u32 0,
+//   then per image: u64 hash, i32 area left, top, width, height, u32 width, u32 height,
+//   u32 offset, u32 0, then the width * height RGBA pixels of each image
+class ImageCache
+{
+public:
+    // Source files come from the archive when it has them, else from disk
+    ImageCache(const AssetArchive *archive, const std::string &path);
+
+    // The area of path, clipped the way sf::Texture does, from the cache if it is fresh.
+    // Safe to call from several threads at once
+    bool load(const std::string &path, const sf::IntRect &area, sf::Image &image) const;
+    // The same, uploaded straight from the cached pixels without making an sf::Image
+    bool loadTexture(const std::string &path, const sf::IntRect &area, sf::Texture &texture) const;
+    // Rewrite the file with the images loaded so far if any had to be decoded, dropping the ones
+    // not asked for. Only once no loads are running
+    bool save();
+
+    // Wall time spent reading cached pixels and decoding PNGs, over all threads
+    struct Stats
+    {
+        std::atomic<int> hits{0};
+        std::atomic<int> decoded{0};
+        std::atomic<long> hit_us{0};
+        std::atomic<long> decode_us{0};
+    };
+    const Stats &stats() const { return counters; }
+
+private:
+    struct Blob;
+    struct Decoded
+    {
+        std::uint64_t hash;
+        sf::IntRect area;
+        sf::Image image;
+    };
+    void open();
+    bool fetch(const std::string &path, const sf::IntRect &area, Blob &blob, sf::Image &decoded) const;
+
+    const AssetArchive *archive;
+    std::string path;
+    MappedFile file;
+    std::size_t count = 0;
+    // Which images in the file have been asked for, and the ones decoded since it was opened
+    mutable std::mutex lock;
+    mutable std::vector<bool> used;
+    mutable std::vector<Decoded> added;
+    mutable Stats counters;
+};
+
+// An image and the part of it wanted, the whole image for an empty area
+struct ImageRequest
+{
+    std::string path;
+    sf::IntRect area;
+};
+
+// Decodes images on a pool of worker threads, so the window keeps drawing while they load.
+// Textures can only be made on the main thread, from images that ready() says are done
+class ImageLoader
+{
+public:
+    // Start loading every request, on threads workers or one per core if 0
+    ImageLoader(const std::vector<ImageRequest> &requests, const ImageCache &cache, unsigned threads = 0);
+    ~ImageLoader();
+    ImageLoader(const ImageLoader &) = delete;
+    ImageLoader &operator=(const ImageLoader &) = delete;
+
+    std::size_t size() const { return count; }
+    const std::string &path(std::size_t i) const { return slots[i].request.path; }
+    // true once image i has been loaded, or has failed to be
+    bool ready(std::size_t i) const;
+    // The requested area of the image, nullptr if it couldn't be loaded. Only valid once ready
+    const sf::Image *image(std::size_t i) const;
+
+private:
+    struct Slot
+    {
+        ImageRequest request;
+        sf::Image image;
+        bool loaded = false;
+        std::atomic<bool> done{false};
+    };
+
+    std::size_t count;
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<std::size_t> next{0};
+    std::vector<std::thread> workers;
+};
+
+#endif
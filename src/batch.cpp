@@ -0,0 +1,229 @@
+#include "batch.h"
+#include "level.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+struct BatchJob
+{
+    int cell;
+    std::uint32_t seed;
+};
+
+struct JobResult
+{
+    Outcome outcome;
+    long steps;
+    // -1 if the stack never settled
+    long settle_step;
+};
+
+// Per-thread step cost tally, merged once all workers are done
+struct CostTally
+{
+    std::vector<std::uint64_t> histogram = std::vector<std::uint64_t>(BATCH_COST_BUCKETS + 1);
+    std::uint64_t max = 0;
+};
+
+static JobResult runJob(const BatchConfig &config, Level &level, int n_boxes, std::uint32_t seed,
+                        InputScript &script, CostTally &tally) {
+    // Nothing is drawn, so the artwork stays empty
+    Artwork art;
+    Simulation sim;
+    sim.params = config.params;
+    startLevel(sim, level, n_boxes, seed, art);
+
+    script.next = 0;
+    Controls controls;
+    Outcome outcome = Outcome::Running;
+    long step = 0;
+    long settle_step = -1;
+    // Steps since the trace started
+    long driven = 0;
+    while (outcome == Outcome::Running && step < config.max_steps) {
+        if (!config.settle_first || sim.settled) {
+            applyInputScript(script, driven++, controls);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        outcome = stepLevel(sim, controls);
+        auto cost = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        tally.histogram[std::min<std::uint64_t>(cost / BATCH_COST_BUCKET, BATCH_COST_BUCKETS)]++;
+        tally.max = std::max<std::uint64_t>(tally.max, cost);
+        step++;
+
+        // Counted from the first of the steps it rested
+        if (settle_step < 0 && sim.settled) {
+            settle_step = step - SETTLE_STEPS;
+        }
+    }
+
+    endLevel(sim, outcome);
+    return JobResult{outcome, step, settle_step};
+}
+
+BatchReport runBatchSweep(const BatchConfig &config, std::vector<Level> &levels) {
+    BatchReport report;
+    std::vector<BatchJob> jobs;
+    for (int n_level = 0; n_level < static_cast<int>(levels.size()); n_level++) {
+        if (config.only_level >= 0 && n_level != config.only_level) continue;
+        for (int n_boxes = MIN_BOXES; n_boxes <= MAX_BOXES; n_boxes++) {
+            if (config.only_boxes >= 0 && n_boxes != config.only_boxes) continue;
+            report.cells.push_back(BatchCell{.level = n_level, .n_boxes = n_boxes});
+            for (int i = 0; i < config.n_seeds; i++) {
+                jobs.push_back(BatchJob{static_cast<int>(report.cells.size() - 1), config.first_seed + i});
+            }
+        }
+    }
+
+    unsigned threads = config.threads ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<JobResult> results(jobs.size());
+    std::vector<CostTally> tallies(threads);
+    std::atomic<std::size_t> next_job{0};
+    auto start = std::chrono::steady_clock::now();
+
+    // Workers pull jobs off a shared counter, so long runs don't hold up a whole thread's share
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            InputScript script = config.script;
+            for (std::size_t i = next_job++; i < jobs.size(); i = next_job++) {
+                const BatchCell &cell = report.cells[jobs[i].cell];
+                results[i] = runJob(config, levels[cell.level], cell.n_boxes, jobs[i].seed, script, tallies[t]);
+            }
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (std::size_t i = 0; i < jobs.size(); i++) {
+        BatchCell &cell = report.cells[jobs[i].cell];
+        cell.runs++;
+        if (results[i].outcome == Outcome::StruckGround) cell.dropped++;
+        if (results[i].settle_step >= 0) cell.settle_steps.push_back(results[i].settle_step);
+        report.steps += results[i].steps;
+    }
+    report.runs = jobs.size();
+
+    report.step_costs.assign(BATCH_COST_BUCKETS + 1, 0);
+    for (const auto &tally : tallies) {
+        for (std::size_t b = 0; b < tally.histogram.size(); b++) {
+            report.step_costs[b] += tally.histogram[b];
+        }
+        report.max_step_cost = std::max(report.max_step_cost, tally.max);
+    }
+    return report;
+}
+
+// Value at fraction p of a sorted list
+static long percentile(const std::vector<long> &sorted, double p) {
+    return sorted[static_cast<std::size_t>(p * (sorted.size() - 1))];
+}
+
+// Step cost in microseconds at fraction p of the histogram
+static double costPercentile(const BatchReport &report, double p) {
+    std::uint64_t count = 0;
+    for (auto n : report.step_costs) count += n;
+    std::uint64_t wanted = static_cast<std::uint64_t>(p * count);
+    std::uint64_t seen = 0;
+    for (std::size_t b = 0; b < report.step_costs.size(); b++) {
+        seen += report.step_costs[b];
+        if (seen > wanted) return (b + 1) * BATCH_COST_BUCKET / 1000.0;
+    }
+    return report.max_step_cost / 1000.0;
+}
+
+static const char *batch_usage =
+    "usage: sambar --batch [--seeds n] [--first-seed n] [--level n] [--boxes n] [--steps n] [--threads n]\n"
+    "                      [--script file] [--density x] [--friction x] [--damping x] [--spawn-min n]\n"
+    "                      [--spawn-per-box n]";
+
+int runBatch(int argc, char *argv[]) {
+    BatchConfig config;
+    config.script = defaultInputScript();
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << arg << std::endl;
+            return -1;
+        }
+        std::string value = argv[++i];
+        bool valid = true;
+        if (arg == "--seeds") {
+            valid = parseValue(value, config.n_seeds) && config.n_seeds >= 1;
+        } else if (arg == "--first-seed") {
+            valid = parseValue(value, config.first_seed);
+        } else if (arg == "--level") {
+            valid = parseValue(value, config.only_level) && config.only_level >= 1;
+            config.only_level--;
+        } else if (arg == "--boxes") {
+            valid = parseValue(value, config.only_boxes) && config.only_boxes >= MIN_BOXES
+                    && config.only_boxes <= MAX_BOXES;
+        } else if (arg == "--steps") {
+            valid = parseValue(value, config.max_steps) && config.max_steps >= 0;
+        } else if (arg == "--threads") {
+            valid = parseValue(value, config.threads);
+        } else if (arg == "--script") {
+            if (!loadInputScript(value, config.script)) {
+                std::cerr << "cannot read input script " << value << std::endl;
+                return -1;
+            }
+            config.settle_first = false;
+        } else if (arg == "--density") {
+            valid = parseValue(value, config.params.density);
+        } else if (arg == "--friction") {
+            valid = parseValue(value, config.params.friction);
+        } else if (arg == "--damping") {
+            valid = parseValue(value, config.params.angular_damping);
+        } else if (arg == "--spawn-min") {
+            valid = parseValue(value, config.params.spawn_min);
+        } else if (arg == "--spawn-per-box") {
+            valid = parseValue(value, config.params.spawn_per_box);
+        } else {
+            std::cerr << "unknown option " << arg << std::endl;
+            return -1;
+        }
+        if (!valid) {
+            std::cerr << "bad value " << value << " for " << arg << std::endl << batch_usage << std::endl;
+            return -1;
+        }
+    }
+
+    AssetArchive archive;
+    std::vector<Level> levels;
+    if (!loadLevels("levels", levels, openAssetArchive(archive, argv[0]) ? &archive : nullptr)) {
+        std::cerr << "cannot read levels" << std::endl;
+        return -1;
+    }
+    if (config.only_level >= static_cast<int>(levels.size())) {
+        std::cerr << "bad value " << config.only_level + 1 << " for --level, there are " << levels.size()
+                  << " levels" << std::endl << batch_usage << std::endl;
+        return -1;
+    }
+    BatchReport report = runBatchSweep(config, levels);
+
+    std::printf("level boxes    runs  ground  settled  settle p50  settle p95\n");
+    for (auto &cell : report.cells) {
+        if (cell.runs == 0) continue;
+        std::sort(cell.settle_steps.begin(), cell.settle_steps.end());
+        std::printf("%5d %5d %7ld %6.1f%% %7.1f%%", cell.level + 1, cell.n_boxes, cell.runs,
+                    100.0 * cell.dropped / cell.runs, 100.0 * cell.settle_steps.size() / cell.runs);
+        if (cell.settle_steps.empty()) {
+            std::printf("           -           -\n");
+        } else {
+            std::printf("  %8.2f s  %8.2f s\n", percentile(cell.settle_steps, 0.5) * TIME_STEP,
+                        percentile(cell.settle_steps, 0.95) * TIME_STEP);
+        }
+    }
+    std::printf("step cost p50 %.1f us, p95 %.1f us, p99 %.1f us, max %.1f us\n",
+                costPercentile(report, 0.5), costPercentile(report, 0.95), costPercentile(report, 0.99),
+                report.max_step_cost / 1000.0);
+    std::printf("%ld runs, %ld steps in %.2f s\n", report.runs, report.steps, report.seconds);
+    return 0;
+}
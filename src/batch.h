@@ -0,0 +1,58 @@
+#ifndef SAMBAR_BATCH_H
+#define SAMBAR_BATCH_H
+
+#include "game.h"
+#include "headless.h"
+#include <cstdint>
+
+// A sweep of seeds x box counts x levels, all driven by the same input trace
+struct BatchConfig
+{
+    int n_seeds = 100;
+    std::uint32_t first_seed = 0;
+    // -1 sweeps everything, otherwise only this level (0 based) or box count
+    int only_level = -1;
+    int only_boxes = -1;
+    long max_steps = 600;
+    unsigned threads = 0;
+    InputScript script;
+    // Start the trace only once the stack has settled, so the default one holding K measures
+    // driving a settled stack rather than driving off under a falling one. A given script
+    // runs from the first step
+    bool settle_first = true;
+    StackParams params;
+};
+
+// Results for one level and box count
+struct BatchCell
+{
+    int level;
+    int n_boxes;
+    long runs = 0;
+    long dropped = 0;
+    // Step at which each settled run came to rest, runs that never settled are left out
+    std::vector<long> settle_steps{};
+};
+
+struct BatchReport
+{
+    std::vector<BatchCell> cells;
+    // Histogram of stepLevel cost in BATCH_COST_BUCKET nanosecond buckets, the last one is overflow
+    std::vector<std::uint64_t> step_costs;
+    std::uint64_t max_step_cost = 0;
+    long runs = 0;
+    long steps = 0;
+    double seconds = 0;
+};
+
+#define BATCH_COST_BUCKET 100
+#define BATCH_COST_BUCKETS 10000
+
+// Run every job of the sweep on a pool of worker threads, one fresh Simulation per run
+BatchReport runBatchSweep(const BatchConfig &config, std::vector<Level> &levels);
+
+// sambar --batch [--seeds n] [--first-seed n] [--level n] [--boxes n] [--steps n] [--threads n]
+//                [--script file] [--density x] [--friction x] [--damping x] [--spawn-min n] [--spawn-per-box n]
+int runBatch(int argc, char *argv[]);
+
+#endif
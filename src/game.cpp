@@ -0,0 +1,360 @@
+#include "game.h"
+#include "stacks.h"
+
+// Driving force and heave for each of the speed keys
+const float fast = 10000.0;
+const float reckless = 13000.0;
+const float heave = 370000.0;
+const float squat = 500000.0;
+
+Box createBox(b2World &world, float x, float y, float width, float height, float density, float friction, const TextureRegion *sprite,
+              float angular_damping)
+{
+    // Body definition
+    b2BodyDef boxBodyDef;
+    boxBodyDef.position.Set(x / PPM, y / PPM);
+    boxBodyDef.type = b2_dynamicBody;
+    boxBodyDef.angularDamping = angular_damping;
+
+    // Shape definition
+    b2PolygonShape boxShape;
+    boxShape.SetAsBox(width / 2 / PPM, height / 2 / PPM);
+
+    // Fixture definition
+    b2FixtureDef fixtureDef;
+    fixtureDef.density = density;
+    fixtureDef.friction = friction;
+    fixtureDef.shape = &boxShape;
+    fixtureDef.userData.pointer = static_cast<uintptr_t>(FixtureKind::Cargo);
+
+    // Now we have a body for our Box object
+    b2Body *boxBody = world.CreateBody(&boxBodyDef);
+    // Lastly, assign the fixture
+    boxBody->CreateFixture(&fixtureDef);
+
+    return Box { width, height, sprite, boxBody };
+}
+
+// Put a pooled body back at x, y, level and at rest, as it was when created
+static void resetBody(b2Body *body, float x, float y) {
+    body->SetTransform(b2Vec2(x / PPM, y / PPM), 0.f);
+    // Sleeping clears velocities and forces, and waking restarts the sleep timer
+    body->SetAwake(false);
+    body->SetAwake(true);
+    body->SetEnabled(true);
+}
+
+// Box i of the stack, reset from the pool or created if the pool hasn't got that many yet
+static Box poolBox(Simulation &sim, std::size_t i, float x, float y, float width, float height, float density,
+                   float friction, const TextureRegion *sprite, float angular_damping) {
+    BodyPool &pool = sim.pool;
+    if (i == pool.cargo.size()) {
+        Box box = createBox(sim.world, x, y, width, height, density, friction, sprite, angular_damping);
+        pool.cargo.push_back(box.body);
+        return box;
+    }
+
+    b2Body *body = pool.cargo[i];
+    body->SetAngularDamping(angular_damping);
+    b2Fixture *fixture = body->GetFixtureList();
+    fixture->SetFriction(friction);
+    if (fixture->GetDensity() != density) {
+        fixture->SetDensity(density);
+        body->ResetMassData();
+    }
+    resetBody(body, x, y);
+    return Box{width, height, sprite, body};
+}
+
+Box createGround(b2World &world, float x, float y, float width, float height, const TextureRegion *sprite)
+{
+    // Static body definition
+    b2BodyDef groundBodyDef;
+    groundBodyDef.position.Set(x / PPM, y / PPM);
+
+    // Shape definition
+    b2PolygonShape groundBox;
+    groundBox.SetAsBox(width / 2 / PPM, height / 2 / PPM);
+
+    // Now we have a body for our Box object
+    b2Body *groundBody = world.CreateBody(&groundBodyDef);
+    // For a static body, we don't need a custom fixture definition, this will do:
+    b2Fixture *fixture = groundBody->CreateFixture(&groundBox, 0.0f);
+    fixture->GetUserData().pointer = static_cast<uintptr_t>(FixtureKind::Ground);
+
+    return Box{ width, height, sprite, groundBody };
+}
+
+bool reachedGoal(Sambar &sambar, Level &level) {
+    float x = sambar.x - level.goal.x;
+    float y = sambar.y - level.goal.y;
+    float dist = std::sqrt(x*x + y*y);
+    return dist < level.goal.radius;
+}
+
+bool struckTree(Sambar &sambar, Level &level) {
+    return terrainAt(level.terrain, sambar.x, sambar.y) == Terrain::Tree;
+}
+
+bool struckMud(Sambar &sambar, Level &level) {
+    return terrainAt(level.terrain, sambar.x, sambar.y) == Terrain::Mud;
+}
+
+FixtureKind fixtureKind(b2Fixture *fixture) {
+    return static_cast<FixtureKind>(fixture->GetUserData().pointer);
+}
+
+// true if the contact is between the ground and a crate or basket
+static bool cargoOnGround(b2Contact *contact) {
+    FixtureKind a = fixtureKind(contact->GetFixtureA());
+    FixtureKind b = fixtureKind(contact->GetFixtureB());
+    return (a == FixtureKind::Ground && b == FixtureKind::Cargo)
+        || (a == FixtureKind::Cargo && b == FixtureKind::Ground);
+}
+
+void GroundListener::BeginContact(b2Contact *contact) {
+    if (cargoOnGround(contact)) {
+        struck = true;
+    }
+}
+
+// return true if no crate or basket is falling or sliding on the truck
+bool stackResting(Simulation &sim) {
+    const b2Vec2 &truck = sim.boxes.back().body->GetLinearVelocity();
+    for (std::size_t i = 1; i + 1 < sim.boxes.size(); i++) {
+        const b2Vec2 &v = sim.boxes[i].body->GetLinearVelocity();
+        // The truck drives on flat ground, so a resting crate never moves vertically
+        if (std::abs(v.y) > REST_SPEED || (v - truck).LengthSquared() > REST_SPEED * REST_SPEED) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void pressControl(Controls &controls, Control control) {
+    switch(control) {
+        case Control::StrongReverse:
+            controls.force = -reckless;
+            controls.angular_impulse = -squat;
+            break;
+        case Control::Reverse:
+            controls.force = -fast;
+            controls.angular_impulse = -heave;
+            break;
+        case Control::Forward:
+            controls.force = fast;
+            controls.angular_impulse = heave;
+            break;
+        case Control::StrongForward:
+            controls.force = reckless;
+            controls.angular_impulse = squat;
+            break;
+        case Control::Left:
+            controls.rotation = -4.f;
+            break;
+        case Control::Right:
+            controls.rotation = 4.f;
+            break;
+    }
+}
+
+void releaseControl(Controls &controls, Control control) {
+    // Speed keys only let go if they were the most recently pressed
+    switch(control) {
+        case Control::StrongReverse:
+            controls.force = controls.force == -reckless ? 0 : controls.force;
+            controls.angular_impulse = controls.angular_impulse == -squat ? 0 : controls.angular_impulse;
+            break;
+        case Control::Reverse:
+            controls.force = controls.force == -fast ? 0 : controls.force;
+            controls.angular_impulse = controls.angular_impulse == -heave ? 0 : controls.angular_impulse;
+            break;
+        case Control::Forward:
+            controls.force = controls.force == fast ? 0 : controls.force;
+            controls.angular_impulse = controls.angular_impulse == heave ? 0 : controls.angular_impulse;
+            break;
+        case Control::StrongForward:
+            controls.force = controls.force == reckless ? 0 : controls.force;
+            controls.angular_impulse = controls.angular_impulse == squat ? 0 : controls.angular_impulse;
+            break;
+        case Control::Left:
+        case Control::Right:
+            controls.rotation = 0.f;
+            break;
+    }
+}
+
+const TextureRegion *stackSprite(const Artwork &art, std::uint32_t kind) {
+    const TextureRegion *sprites[STACK_SPRITES] {art.crate1, art.crate2, art.basket1, art.basket2};
+    return sprites[kind % STACK_SPRITES];
+}
+
+void startLevel(Simulation &sim, Level &level, int n_boxes, std::uint32_t seed, Artwork &art, int stack) {
+    std::mt19937 gen{seed};
+    std::uniform_int_distribution<> d{0, 1000};
+
+    sim.level = &level;
+    sim.n_boxes = n_boxes;
+
+    // Generate ground, kept where it is between levels
+    BodyPool &pool = sim.pool;
+    if (!pool.ground.body) {
+        pool.ground = createGround(sim.world, 350, 80, 50000, 100, art.crate1);
+    }
+    pool.ground.body->SetEnabled(true);
+    pool.ground.sprite = art.crate1;
+    sim.boxes.push_back(pool.ground);
+
+    // Generate a lot of boxes
+    const StackParams &params = sim.params;
+    int band = params.spawn_per_box * n_boxes - params.spawn_min + 1;
+    if (band == 0) band = 1;
+    const SettledStack *settled = stack >= 0 ? &sim.stacks->stacks[stack] : nullptr;
+    for (std::size_t i = 0; i < static_cast<std::size_t>(n_boxes); i++)
+    {
+        // A cached stack goes straight where it came to rest
+        if (settled) {
+            const SettledBody &body = settled->bodies[i];
+            auto &&box = poolBox(sim, i, body.x * PPM, body.y * PPM, 32, 24, params.density, params.friction,
+                                 stackSprite(art, body.sprite), params.angular_damping);
+            box.body->SetTransform(b2Vec2(body.x, body.y), body.angle);
+            sim.boxes.push_back(box);
+            continue;
+        }
+
+        // Starting positions are randomly generated: x between 74 and 86, y between 270 and 55*n boxes
+        auto &&box = poolBox(sim, i,
+                               80 + (d(gen) % 6),
+                               params.spawn_min + (d(gen) % band),
+                               32,
+                               24,
+                               params.density,
+                               params.friction,
+                               stackSprite(art, d(gen)),
+                               params.angular_damping);
+        sim.boxes.push_back(box);
+    }
+
+    // Create a sambar box
+    if (!pool.truck.body) {
+        pool.truck = createBox(sim.world, 90, 200, 72, 30, SAMBAR_DENSITY, 0.7f, art.sambar_side);
+        pool.truck.height = 64;
+        pool.truck.body->GetFixtureList()->GetUserData().pointer = static_cast<uintptr_t>(FixtureKind::Truck);
+    } else {
+        resetBody(pool.truck.body, 90, 200);
+    }
+    if (settled) {
+        const SettledBody &truck = settled->bodies.back();
+        pool.truck.body->SetTransform(b2Vec2(truck.x, truck.y), truck.angle);
+    }
+    pool.truck.sprite = art.sambar_side;
+    sim.boxes.push_back(pool.truck);
+    sim.ground.struck = false;
+
+    // Bodies know their place in boxes, so a world query can find their sprite and last pose
+    for (std::size_t i = 0; i < sim.boxes.size(); i++) {
+        sim.boxes[i].body->GetUserData().pointer = i;
+    }
+
+    // Create a sambar from above
+    sim.sambar_top = Sambar {.x = level.start.x,
+                             .y = level.start.y,
+                             .rotation = level.start.angle,
+                             .sprite = art.sambar_top};
+
+    sim.resting = 0;
+    sim.settled = settled != nullptr;
+    captureWorld(sim.retry_point, sim);
+    if (settled) {
+        // Warm-start the contacts the stack came to rest on, so it starts out as still as it was
+        sim.retry_point.contacts = settled->contacts;
+        restoreWorld(sim, sim.retry_point);
+    }
+}
+
+Outcome stepLevel(Simulation &sim, const Controls &controls) {
+    b2Body* sambar = sim.boxes.back().body;
+    Sambar &sambar_top = sim.sambar_top;
+
+    // Apply updates to sambar side
+    sambar->ApplyForceToCenter(b2Vec2(controls.force, 10), true);
+    sambar->ApplyAngularImpulse(controls.angular_impulse, true);
+
+    // Apply updates to sambar top, scaled to the step length
+    ProfileTime zone_start = profileStart(sim.profiler);
+    float from_x = sambar_top.x;
+    float from_y = sambar_top.y;
+    sambar_top.rotation += controls.rotation * TOP_STEP_SCALE;
+    auto & v = sambar->GetLinearVelocity();
+    // We will only use horizontal component, not vertical
+    sambar_top.x += std::sin(sambar_top.rotation / DEG_PER_RAD) * v.x * TOP_STEP_SCALE;
+    sambar_top.y += std::cos(sambar_top.rotation / DEG_PER_RAD) * v.x * TOP_STEP_SCALE;
+    profileEnd(sim.profiler, Zone::TopDown, zone_start);
+
+    sim.world.Step(TIME_STEP, 6, 3);
+    if (sim.profiler) profileStep(*sim.profiler, sim.world.GetProfile());
+    if (!sim.settled) {
+        sim.resting = stackResting(sim) ? sim.resting + 1 : 0;
+        // Past the drop, so a retry can skip it
+        if (sim.resting > SETTLE_STEPS) {
+            sim.settled = true;
+            captureWorld(sim.retry_point, sim);
+        }
+    }
+    // Sweep the whole move so a fast sambar can't skip through a tree in one step
+    zone_start = profileStart(sim.profiler);
+    float toi;
+    if (sweepTerrain(sim.level->terrain, Terrain::Tree, from_x, from_y, sambar_top.x, sambar_top.y, toi)) {
+        // Stop at the point of contact and rebound from there
+        sambar_top.x = from_x + (sambar_top.x - from_x) * toi;
+        sambar_top.y = from_y + (sambar_top.y - from_y) * toi;
+        // instant rebound, timestep 1/60
+        b2Vec2 rebound(-SAMBAR_DENSITY * 60. * 2. * sambar->GetLinearVelocity());
+        sambar->ApplyForceToCenter(rebound, true);
+    }
+    if (struckMud(sambar_top, *sim.level)) {
+        // instant slowdown, timestep 1/60
+        b2Vec2 rebound(-SAMBAR_DENSITY * 60. * 0.25 * sambar->GetLinearVelocity());
+        sambar->ApplyForceToCenter(rebound, true);
+    }
+    bool reached = reachedGoal(sambar_top, *sim.level);
+    profileEnd(sim.profiler, Zone::Obstacles, zone_start);
+    if (reached) return Outcome::ReachedGoal;
+    if (sim.ground.struck) return Outcome::StruckGround;
+    return Outcome::Running;
+}
+
+bool retryLevel(Simulation &sim) {
+    if (!restoreWorld(sim, sim.retry_point)) return false;
+    // Back at the start, the stack has to settle all over again
+    if (!sim.settled) sim.resting = 0;
+    return true;
+}
+
+Pose bodyPose(b2Body *body) {
+    const b2Vec2 &p = body->GetPosition();
+    return Pose{p.x, p.y, body->GetAngle()};
+}
+
+Pose blendPose(const Pose &from, const Pose &to, float alpha) {
+    return Pose{from.x + (to.x - from.x) * alpha,
+                from.y + (to.y - from.y) * alpha,
+                from.angle + (to.angle - from.angle) * alpha};
+}
+
+void rememberPoses(Simulation &sim) {
+    sim.previous.resize(sim.boxes.size());
+    for (std::size_t i = 0; i < sim.boxes.size(); i++) {
+        sim.previous[i] = bodyPose(sim.boxes[i].body);
+    }
+    sim.previous_top = Pose{sim.sambar_top.x, sim.sambar_top.y, sim.sambar_top.rotation};
+}
+
+void endLevel(Simulation &sim, Outcome outcome) {
+    if (outcome == Outcome::ReachedGoal) sim.total += sim.n_boxes;
+    // Disabled bodies leave the broad-phase and end their contacts, as if destroyed
+    for (auto & box : sim.boxes) {
+        box.body->SetEnabled(false);
+    }
+    sim.boxes.clear();
+}
@@ -0,0 +1,227 @@
+#ifndef SAMBAR_GAME_H
+#define SAMBAR_GAME_H
+
+#include "obstacles.h"
+#include "profiler.h"
+#include "terrain.h"
+#include "textures.h"
+#include "world_snapshot.h"
+#include <SFML/Graphics.hpp>
+#include <box2d/box2d.h>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#define WINDOW_WIDTH 800
+#define WINDOW_HEIGHT 600
+
+// Pixels per meter. Box2D uses metric units, so we need to define a conversion
+#define PPM 30.0F
+// SFML uses degrees for angles while Box2D uses radians
+#define DEG_PER_RAD 57.2957795F
+
+// The level image is drawn this many times its size, centred in the window
+#define MAP_SCALE 1.8f
+
+// Physics runs in fixed steps of 1/60 s whatever the display rate
+#define TIME_STEP (1 / 60.f)
+// Top-down speeds and turn rates are tuned in units per 1/60 s
+#define TOP_STEP_SCALE (TIME_STEP * 60.f)
+// Longest frame the window loop will catch up on, and most steps it runs per frame
+#define MAX_FRAME_TIME 0.25f
+#define MAX_STEPS_PER_FRAME 8
+#define SAMBAR_DENSITY 800.f
+// Below this speed in m/s relative to the truck, a crate counts as resting
+#define REST_SPEED 0.05f
+// The stack counts as settled once it has rested this many steps in a row
+#define SETTLE_STEPS 30
+// Every level is played with each stack size from MIN_BOXES up to MAX_BOXES crates
+#define MIN_BOXES 2
+#define MAX_BOXES 11
+
+// A structure with all we need to render a box
+struct Box
+{
+    float width;
+    float height;
+    const TextureRegion *sprite;
+    b2Body *body;
+};
+
+struct Sambar
+{
+    float x;
+    float y;
+    float rotation;
+    const TextureRegion *sprite;
+};
+
+// Position and angle of a body or the top-down sambar, kept to interpolate between steps
+struct Pose
+{
+    float x;
+    float y;
+    float angle;
+};
+
+struct Level
+{
+    std::string texture_path;
+    const sf::Texture *texture = nullptr;
+    // Where the top-down sambar starts (rotation in angle) and the circle it must reach
+    Pose start{155.f, 520.f, 180.f};
+    Obstacle goal{WINDOW_WIDTH - 145.f, 30.f, 30.f};
+    TerrainMask terrain;
+};
+
+// Sprites in the shared atlas, all nullptr when running without a window
+struct Artwork
+{
+    const TextureRegion *basket1 = nullptr;
+    const TextureRegion *basket2 = nullptr;
+    const TextureRegion *crate1 = nullptr;
+    const TextureRegion *crate2 = nullptr;
+    const TextureRegion *sambar_left = nullptr;
+    const TextureRegion *sambar_right = nullptr;
+    const TextureRegion *sambar_side = nullptr;
+    const TextureRegion *sambar_top = nullptr;
+};
+
+// Crates and baskets come in this many kinds of sprite
+#define STACK_SPRITES 4
+const TextureRegion *stackSprite(const Artwork &art, std::uint32_t kind);
+
+// Driving commands, one per key: H, J, K, L, A, D
+enum class Control
+{
+    StrongReverse,
+    Reverse,
+    Forward,
+    StrongForward,
+    Left,
+    Right
+};
+
+// What the held controls currently apply to the sambar
+struct Controls
+{
+    float force = 0.f;
+    float angular_impulse = 0.f;
+    float rotation = 0.f;
+};
+
+enum class Outcome
+{
+    Running,
+    StruckGround,
+    ReachedGoal
+};
+
+// Tunables for the stack dropped onto the truck
+struct StackParams
+{
+    float density = 80.f;
+    float friction = 0.7f;
+    float angular_damping = 100000.0f;
+    // Crates start between spawn_min and spawn_per_box * n_boxes pixels up
+    int spawn_min = 270;
+    int spawn_per_box = 72;
+};
+
+// What a fixture belongs to, stored in its user data
+enum class FixtureKind : uintptr_t
+{
+    None,
+    Ground,
+    Cargo,
+    Truck
+};
+
+// Watches for crates and baskets touching the ground while the world steps
+class GroundListener : public b2ContactListener
+{
+public:
+    void BeginContact(b2Contact *contact) override;
+
+    // Set by the first strike of the level
+    bool struck = false;
+};
+
+struct StackCache;
+
+// Bodies kept from one level to the next, disabled while unused, so a restart moves them back
+// into place instead of rebuilding them in the world
+struct BodyPool
+{
+    Box ground{};
+    Box truck{};
+    // Crates and baskets, as many as the biggest stack so far. All share one shape
+    std::vector<b2Body *> cargo;
+};
+
+// One game in progress. Every session owns its physics world, so separate
+// sessions can be stepped on separate threads
+struct Simulation
+{
+    Simulation() { world.SetContactListener(&ground); }
+    Simulation(const Simulation &) = delete;
+    Simulation &operator=(const Simulation &) = delete;
+
+    // Box2D world for physics simulation, gravity = 9.8 m/s^2
+    b2World world{b2Vec2(0, -9.8)};
+    GroundListener ground;
+    // Ground first, then n_boxes crates and baskets, then the sambar. Each body's user data
+    // holds its index here
+    std::vector<Box> boxes;
+    BodyPool pool;
+    Sambar sambar_top;
+    Level *level = nullptr;
+    int n_boxes = 0;
+    int total = 0;
+    StackParams params;
+    // Stacks already at rest that a level can start from instead of dropping one, only valid for
+    // the default params
+    const StackCache *stacks = nullptr;
+    // Where each step's phases are timed, if anywhere
+    Profiler *profiler = nullptr;
+    // Poses before the latest step, one per box, for rendering between steps
+    std::vector<Pose> previous;
+    Pose previous_top;
+    // Steps the stack has rested in a row, until it settles. Retries go back to retry_point, the
+    // level's start until then and the world as it settled after
+    int resting = 0;
+    bool settled = false;
+    WorldSnapshot retry_point;
+};
+
+Box createBox(b2World &world, float x, float y, float width, float height, float density, float friction, const TextureRegion *sprite,
+              float angular_damping = 100000.0f);
+Box createGround(b2World &world, float x, float y, float width, float height, const TextureRegion *sprite);
+FixtureKind fixtureKind(b2Fixture *fixture);
+
+bool reachedGoal(Sambar &sambar, Level &level);
+bool struckTree(Sambar &sambar, Level &level);
+bool struckMud(Sambar &sambar, Level &level);
+bool stackResting(Simulation &sim);
+
+void pressControl(Controls &controls, Control control);
+void releaseControl(Controls &controls, Control control);
+
+// Drop a fresh stack generated from seed onto the truck, or with stack >= 0, start with that one
+// of sim.stacks already settled on it
+void startLevel(Simulation &sim, Level &level, int n_boxes, std::uint32_t seed, Artwork &art, int stack = -1);
+// Advance one frame: drive the sambar, step the world and check the map
+Outcome stepLevel(Simulation &sim, const Controls &controls);
+// Start the level over with the same stack, already settled if it had settled before. Returns
+// false, leaving sim as it was, if the retry point doesn't fit its bodies, and the level has to
+// be started afresh instead
+bool retryLevel(Simulation &sim);
+// Save the current poses as the ones to interpolate from
+void rememberPoses(Simulation &sim);
+Pose bodyPose(b2Body *body);
+Pose blendPose(const Pose &from, const Pose &to, float alpha);
+// Score the level and put its bodies back in the pool for the next one
+void endLevel(Simulation &sim, Outcome outcome);
+
+#endif
@@ -0,0 +1,281 @@
+#include "headless.h"
+#include "level.h"
+#include "stacks.h"
+#include "world_file.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static bool controlForKey(char key, Control &control) {
+    switch (key) {
+        case 'H': control = Control::StrongReverse; return true;
+        case 'J': control = Control::Reverse; return true;
+        case 'K': control = Control::Forward; return true;
+        case 'L': control = Control::StrongForward; return true;
+        case 'A': control = Control::Left; return true;
+        case 'D': control = Control::Right; return true;
+    }
+    return false;
+}
+
+bool loadInputScript(const std::string &path, InputScript &script) {
+    std::ifstream in(path);
+    if (!in) return false;
+
+    script = InputScript{};
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        InputEvent event;
+        char key;
+        std::string action;
+        if (!(fields >> event.step >> key >> action)) return false;
+        if (!controlForKey(std::toupper(key), event.control)) return false;
+        if (action != "down" && action != "up") return false;
+        event.pressed = action == "down";
+        script.events.push_back(event);
+    }
+    std::stable_sort(script.events.begin(), script.events.end(),
+                     [](const InputEvent &a, const InputEvent &b) { return a.step < b.step; });
+    return true;
+}
+
+InputScript defaultInputScript() {
+    InputScript script;
+    script.events.push_back(InputEvent{0, Control::Forward, true});
+    return script;
+}
+
+void applyInputScript(InputScript &script, long step, Controls &controls) {
+    while (script.next < script.events.size() && script.events[script.next].step <= step) {
+        const InputEvent &event = script.events[script.next++];
+        if (event.pressed) {
+            pressControl(controls, event.control);
+        } else {
+            releaseControl(controls, event.control);
+        }
+    }
+}
+
+// Step the level already started in sim until it ends or max_steps pass
+static HeadlessResult playLevel(Simulation &sim, const InputSource &input, long max_steps, ReplayRun *record) {
+    Controls controls;
+    Outcome outcome = Outcome::Running;
+    long step = 0;
+    while (outcome == Outcome::Running && step < max_steps) {
+        input(step, controls);
+        if (record) recordControls(*record, step, controls);
+        outcome = stepLevel(sim, controls);
+        step++;
+    }
+
+    if (record) finishRun(*record, step, outcome, sim);
+    endLevel(sim, outcome);
+    return HeadlessResult{outcome, step};
+}
+
+HeadlessResult runLevelHeadless(Simulation &sim, int n_boxes, Level &level, std::uint32_t seed, int stack,
+                                const InputSource &input, long max_steps, ReplayRun *record) {
+    // No textures are loaded without a window, so the artwork stays empty
+    Artwork art;
+    startLevel(sim, level, n_boxes, seed, art, stack);
+    return playLevel(sim, input, max_steps, record);
+}
+
+// Play back every run in a replay file and check each one ends exactly as recorded
+static int replayHeadless(const std::string &path, std::vector<Level> &levels, const StackCache &stacks) {
+    std::vector<ReplayRun> runs;
+    if (!loadReplay(path, runs)) {
+        std::cerr << "cannot read replay " << path << std::endl;
+        return -1;
+    }
+
+    // Runs share one session, as they did when recorded
+    Simulation sim;
+    sim.stacks = &stacks;
+    int mismatches = 0;
+    for (const auto &run : runs) {
+        if (!validRun(run, levels.size(), stacks)) {
+            std::cerr << "replay uses missing level " << run.level + 1 << " or stack " << run.stack
+                      << " for " << run.n_boxes << " boxes" << std::endl;
+            return -1;
+        }
+        ReplayCursor cursor{.run = &run};
+        ReplayRun check{.seed = run.seed, .level = run.level, .n_boxes = run.n_boxes, .stack = run.stack};
+        HeadlessResult result = runLevelHeadless(sim, run.n_boxes, levels[run.level], run.seed, run.stack,
+            [&](long step, Controls &controls) {
+                controls = replayControls(cursor, step);
+                if (cursor.retry && !retryLevel(sim)) {
+                    Artwork art;
+                    endLevel(sim, Outcome::Running);
+                    startLevel(sim, levels[run.level], run.n_boxes, run.seed, art, run.stack);
+                }
+            },
+            run.steps, &check);
+        bool same = result.outcome == run.outcome && result.steps == run.steps
+                    && check.final_hash == run.final_hash;
+        if (!same) mismatches++;
+        std::cout << "level " << run.level + 1 << " boxes " << run.n_boxes << " seed " << run.seed
+                  << ": " << result.steps << " steps, " << (same ? "matches" : "DIFFERS from") << " recording"
+                  << std::endl;
+    }
+    std::cout << runs.size() - mismatches << " of " << runs.size() << " runs replayed exactly" << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Play on from a saved world with the script, as a bug report or a benchmark from a known scene
+static int worldHeadless(const std::string &path, std::vector<Level> &levels, InputScript &script, long max_steps,
+                         Profiler *profiler) {
+    Simulation sim;
+    sim.profiler = profiler;
+    Artwork art;
+    int level;
+    auto start = std::chrono::steady_clock::now();
+    if (!loadWorld(path, sim, levels, art, level)) {
+        std::cerr << "cannot read world " << path << std::endl;
+        return -1;
+    }
+    std::chrono::duration<double> loaded = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    HeadlessResult result = playLevel(sim,
+        [&](long step, Controls &controls) { applyInputScript(script, step, controls); }, max_steps, nullptr);
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+    const char *outcomes[] {"ran out of steps", "dropped a box", "reached the goal"};
+    double simulated = result.steps * TIME_STEP;
+    std::cout << "level " << level + 1 << " boxes " << sim.n_boxes << " loaded in " << loaded.count() * 1000
+              << " ms: " << outcomes[static_cast<int>(result.outcome)] << " after " << result.steps
+              << " steps, " << simulated << " simulated seconds in " << wall.count() << " s ("
+              << simulated / wall.count() << "x realtime)" << std::endl;
+    if (profiler) printProfile(std::cout, *profiler);
+    return 0;
+}
+
+static const char *headless_usage = "usage: sambar --headless [--script file] [--level n] [--boxes n] [--steps n] "
+                                    "[--profile] [--record file | --replay file | --world file]";
+
+int runHeadless(int argc, char *argv[]) {
+    InputScript script = defaultInputScript();
+    int only_level = -1;
+    int only_boxes = -1;
+    long max_steps = 60 * 60;
+    std::string record_path;
+    std::string replay_path;
+    std::string world_path;
+
+    bool profile = false;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--profile") {
+            profile = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << arg << std::endl;
+            return -1;
+        }
+        std::string value = argv[++i];
+        bool valid = true;
+        if (arg == "--script") {
+            if (!loadInputScript(value, script)) {
+                std::cerr << "cannot read input script " << value << std::endl;
+                return -1;
+            }
+        } else if (arg == "--level") {
+            valid = parseValue(value, only_level) && only_level >= 1;
+            only_level--;
+        } else if (arg == "--boxes") {
+            valid = parseValue(value, only_boxes) && only_boxes >= MIN_BOXES && only_boxes <= MAX_BOXES;
+        } else if (arg == "--steps") {
+            valid = parseValue(value, max_steps) && max_steps >= 0;
+        } else if (arg == "--record") {
+            record_path = value;
+        } else if (arg == "--replay") {
+            replay_path = value;
+        } else if (arg == "--world") {
+            world_path = value;
+        } else {
+            std::cerr << "unknown option " << arg << std::endl;
+            return -1;
+        }
+        if (!valid) {
+            std::cerr << "bad value " << value << " for " << arg << std::endl << headless_usage << std::endl;
+            return -1;
+        }
+    }
+
+    AssetArchive archive;
+    const AssetArchive *packed = openAssetArchive(archive, argv[0]) ? &archive : nullptr;
+    std::vector<Level> levels;
+    if (!loadLevels("levels", levels, packed)) {
+        std::cerr << "cannot read levels" << std::endl;
+        return -1;
+    }
+    StackCache stacks;
+    if (!loadStacks(STACK_FILE, stacks, packed)) {
+        std::cerr << "cannot read stacks" << std::endl;
+        return -1;
+    }
+    if (only_level >= static_cast<int>(levels.size())) {
+        std::cerr << "bad value " << only_level + 1 << " for --level, there are " << levels.size()
+                  << " levels" << std::endl << headless_usage << std::endl;
+        return -1;
+    }
+
+    if (!replay_path.empty()) {
+        return replayHeadless(replay_path, levels, stacks);
+    }
+    // Physics phase timings over the latest steps, reported at the end
+    Profiler profiler;
+    if (!world_path.empty()) {
+        return worldHeadless(world_path, levels, script, max_steps, profile ? &profiler : nullptr);
+    }
+
+    std::ofstream record;
+    if (!record_path.empty()) {
+        record.open(record_path, std::ios::binary);
+        if (!writeReplayHeader(record)) {
+            std::cerr << "cannot write replay " << record_path << std::endl;
+            return -1;
+        }
+    }
+
+    Simulation sim;
+    sim.stacks = &stacks;
+    if (profile) sim.profiler = &profiler;
+    std::random_device rd{};
+    const char *outcomes[] {"ran out of steps", "dropped a box", "reached the goal"};
+    long total_steps = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    // Same progression as the game: each level from 2 up to 11 boxes
+    for (int n_level = 0; n_level < static_cast<int>(levels.size()); n_level++) {
+        if (only_level >= 0 && n_level != only_level) continue;
+        for (int n_boxes = MIN_BOXES; n_boxes <= MAX_BOXES; n_boxes++) {
+            if (only_boxes >= 0 && n_boxes != only_boxes) continue;
+            ReplayRun run{.seed = rd(), .level = n_level, .n_boxes = n_boxes};
+            run.stack = pickStack(stacks, n_boxes, run.seed);
+            script.next = 0;
+            HeadlessResult result = runLevelHeadless(sim, n_boxes, levels[n_level], run.seed, run.stack,
+                [&](long step, Controls &controls) { applyInputScript(script, step, controls); },
+                max_steps, record.is_open() ? &run : nullptr);
+            if (record.is_open()) writeReplayRun(record, run);
+            total_steps += result.steps;
+            std::cout << "level " << n_level + 1 << " boxes " << n_boxes << ": "
+                      << outcomes[static_cast<int>(result.outcome)]
+                      << " after " << result.steps << " steps" << std::endl;
+        }
+    }
+
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+    double simulated = total_steps * TIME_STEP;
+    std::cout << "score " << sim.total << ", " << simulated << " simulated seconds in "
+              << wall.count() << " s (" << simulated / wall.count() << "x realtime)" << std::endl;
+    if (profile) printProfile(std::cout, profiler);
+    return 0;
+}
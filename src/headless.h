@@ -0,0 +1,59 @@
+#ifndef SAMBAR_HEADLESS_H
+#define SAMBAR_HEADLESS_H
+
+#include "game.h"
+#include "replay.h"
+#include <charconv>
+#include <functional>
+#include <string>
+
+// A key press or release at a given simulation step
+struct InputEvent
+{
+    long step;
+    Control control;
+    bool pressed;
+};
+
+// Scripted stand-in for the keyboard, events sorted by step
+struct InputScript
+{
+    std::vector<InputEvent> events;
+    std::size_t next = 0;
+};
+
+// Read a whole command-line value as a number, false if any of it isn't one or it is out of range
+template<typename T>
+bool parseValue(const std::string &text, T &value) {
+    const char *end = text.data() + text.size();
+    auto [last, error] = std::from_chars(text.data(), end, value);
+    return error == std::errc() && last == end;
+}
+
+// Script files hold one "<step> <key> <down|up>" event per line, keys as in the game (HJKLAD)
+bool loadInputScript(const std::string &path, InputScript &script);
+// Used when no script is given: hold K (forward) for the whole run
+InputScript defaultInputScript();
+// Apply every event due at this step
+void applyInputScript(InputScript &script, long step, Controls &controls);
+
+struct HeadlessResult
+{
+    Outcome outcome;
+    long steps;
+};
+
+// Fills in the controls for a step, called once per step in order
+typedef std::function<void(long step, Controls &controls)> InputSource;
+
+// Run a level of sim with no window as fast as possible, stopping after max_steps if still running.
+// The stack comes from seed, or from sim.stacks if stack >= 0, and the run is recorded into record
+// if given
+HeadlessResult runLevelHeadless(Simulation &sim, int n_boxes, Level &level, std::uint32_t seed, int stack,
+                                const InputSource &input, long max_steps, ReplayRun *record = nullptr);
+
+// sambar --headless [--script file] [--level n] [--boxes n] [--steps n] [--profile]
+//                   [--record file | --replay file | --world file]
+int runHeadless(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,27 @@
+#include "hud.h"
+#include <string>
+
+#define HUD_CHARACTER_SIZE 72
+#define HUD_OUTLINE 2.f
+
+void setupHud(Hud &hud, const sf::Font &font) {
+    hud.score.setFont(font);
+    hud.score.setLetterSpacing(1.3);
+    hud.score.setCharacterSize(HUD_CHARACTER_SIZE);
+    hud.score.setOutlineThickness(HUD_OUTLINE);
+    hud.shown = -1;
+
+    // Outlined text needs each glyph twice, once plain for the fill and once for the outline
+    for (char c : std::string("SCORE: 0123456789")) {
+        font.getGlyph(c, HUD_CHARACTER_SIZE, false);
+        font.getGlyph(c, HUD_CHARACTER_SIZE, false, HUD_OUTLINE);
+    }
+}
+
+void drawHud(sf::RenderTarget &target, Hud &hud, int total) {
+    if (total != hud.shown) {
+        hud.score.setString("SCORE: " + std::to_string(total));
+        hud.shown = total;
+    }
+    target.draw(hud.score);
+}
@@ -0,0 +1,19 @@
+#ifndef SAMBAR_HUD_H
+#define SAMBAR_HUD_H
+
+#include <SFML/Graphics.hpp>
+
+// Score banner over the side view. sf::Text keeps its fill and outline vertices until its string
+// changes, so it is only given a new string when the score does
+struct Hud
+{
+    sf::Text score;
+    int shown = -1;
+};
+
+// Style the banner and render every glyph it can show into the font's texture up front,
+// so the first frame of a level doesn't stop to rasterise them
+void setupHud(Hud &hud, const sf::Font &font);
+void drawHud(sf::RenderTarget &target, Hud &hud, int total);
+
+#endif
@@ -0,0 +1,253 @@
+#include "level.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#define LEVEL_VERSION 2
+#define LEVEL_TEXTURE_PATH 64
+// Widest or tallest terrain mask a level file may hold, in texels
+#define LEVEL_MAX_TERRAIN 4096
+
+static_assert(std::endian::native == std::endian::little, "level files are read in place as little endian");
+static_assert(sizeof(Obstacle) == 3 * sizeof(float), "obstacles are copied straight from level files");
+static_assert(sizeof(Terrain) == 1, "terrain texels are copied straight from level files");
+
+struct LevelHeader
+{
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t tree_count;
+    std::uint32_t mud_count;
+    float start[3];
+    float goal[3];
+    char texture[LEVEL_TEXTURE_PATH];
+    std::uint32_t tree_colours;
+    std::uint32_t mud_colours;
+    std::uint32_t columns;
+    std::uint32_t rows;
+    float left;
+    float top;
+    float texel_size;
+};
+
+// Read a level from its file contents, which must be 4-byte aligned
+static bool parseLevel(const unsigned char *bytes, std::size_t size, Level &level, LevelSource *source) {
+    if (size < sizeof(LevelHeader)) return false;
+
+    LevelHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, "SLVL", 4) != 0 || header.version != LEVEL_VERSION) return false;
+    std::size_t obstacles_size = (std::size_t(header.tree_count) + header.mud_count) * sizeof(Obstacle);
+    std::size_t colours_size = (std::size_t(header.tree_colours) + header.mud_colours) * sizeof(std::uint32_t);
+    std::size_t texels = std::size_t(header.columns) * header.rows;
+    if (size != sizeof(header) + obstacles_size + colours_size + texels) return false;
+    // Terrain lookups divide by the texel size and index by rows and columns, so those have to be sane
+    if (!std::isfinite(header.left) || !std::isfinite(header.top) || !std::isfinite(header.texel_size)
+        || header.texel_size <= 0.f || header.columns > LEVEL_MAX_TERRAIN || header.rows > LEVEL_MAX_TERRAIN) {
+        return false;
+    }
+    // and every texel one of the kinds of terrain
+    const unsigned char *texel_bytes = bytes + sizeof(header) + obstacles_size + colours_size;
+    if (std::any_of(texel_bytes, texel_bytes + texels,
+                    [](unsigned char texel) { return texel > static_cast<unsigned char>(Terrain::Mud); })) {
+        return false;
+    }
+
+    level.texture_path.assign(header.texture, strnlen(header.texture, LEVEL_TEXTURE_PATH));
+    level.start = Pose{header.start[0], header.start[1], header.start[2]};
+    level.goal = Obstacle{header.goal[0], header.goal[1], header.goal[2]};
+
+    // One allocation per list, filled by a single copy from the mapping
+    const unsigned char *data = bytes + sizeof(header);
+    if (source) {
+        const Obstacle *obstacles = reinterpret_cast<const Obstacle *>(data);
+        source->trees.assign(obstacles, obstacles + header.tree_count);
+        source->mud.assign(obstacles + header.tree_count, obstacles + header.tree_count + header.mud_count);
+        const std::uint32_t *colours = reinterpret_cast<const std::uint32_t *>(data + obstacles_size);
+        source->palette.tree.assign(colours, colours + header.tree_colours);
+        source->palette.mud.assign(colours + header.tree_colours,
+                                   colours + header.tree_colours + header.mud_colours);
+    }
+    const Terrain *mask = reinterpret_cast<const Terrain *>(data + obstacles_size + colours_size);
+    level.terrain.left = header.left;
+    level.terrain.top = header.top;
+    level.terrain.texel_size = header.texel_size;
+    level.terrain.columns = header.columns;
+    level.terrain.rows = header.rows;
+    level.terrain.texels.assign(mask, mask + texels);
+    return true;
+}
+
+bool loadLevel(const std::string &path, Level &level, LevelSource *source) {
+    MappedFile file;
+    return file.open(path) && parseLevel(file.data(), file.size(), level, source);
+}
+
+bool saveLevel(const std::string &path, const Level &level, const LevelSource &source) {
+    if (level.texture_path.size() >= LEVEL_TEXTURE_PATH) return false;
+
+    LevelHeader header{};
+    std::memcpy(header.magic, "SLVL", 4);
+    header.version = LEVEL_VERSION;
+    header.tree_count = source.trees.size();
+    header.mud_count = source.mud.size();
+    header.start[0] = level.start.x;
+    header.start[1] = level.start.y;
+    header.start[2] = level.start.angle;
+    header.goal[0] = level.goal.x;
+    header.goal[1] = level.goal.y;
+    header.goal[2] = level.goal.radius;
+    std::memcpy(header.texture, level.texture_path.data(), level.texture_path.size());
+    header.tree_colours = source.palette.tree.size();
+    header.mud_colours = source.palette.mud.size();
+    header.columns = level.terrain.columns;
+    header.rows = level.terrain.rows;
+    header.left = level.terrain.left;
+    header.top = level.terrain.top;
+    header.texel_size = level.terrain.texel_size;
+
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(source.trees.data()), source.trees.size() * sizeof(Obstacle));
+    out.write(reinterpret_cast<const char *>(source.mud.data()), source.mud.size() * sizeof(Obstacle));
+    out.write(reinterpret_cast<const char *>(source.palette.tree.data()), source.palette.tree.size() * sizeof(std::uint32_t));
+    out.write(reinterpret_cast<const char *>(source.palette.mud.data()), source.palette.mud.size() * sizeof(std::uint32_t));
+    out.write(reinterpret_cast<const char *>(level.terrain.texels.data()), level.terrain.texels.size());
+    return static_cast<bool>(out);
+}
+
+bool bakeLevel(Level &level, const LevelSource &source) {
+    sf::Image image;
+    if (!image.loadFromFile(level.texture_path)) return false;
+
+    // Same placement as the map sprite: scaled about the middle of the window, y flipped
+    sf::Vector2u size = image.getSize();
+    float left = 0.5f * WINDOW_WIDTH - 0.5f * MAP_SCALE * size.x;
+    float top = WINDOW_HEIGHT - (0.5f * WINDOW_HEIGHT - 0.5f * MAP_SCALE * size.y);
+    bakeTerrain(level.terrain, image.getPixelsPtr(), size.x, size.y, source.palette, left, top, MAP_SCALE);
+
+    for (const auto &tree : source.trees) {
+        stampTerrain(level.terrain, tree, Terrain::Tree);
+    }
+    for (const auto &mud : source.mud) {
+        stampTerrain(level.terrain, mud, Terrain::Mud);
+    }
+    // Whatever the art puts there, the goal can always be driven into
+    stampTerrain(level.terrain, level.goal, Terrain::Clear);
+    return true;
+}
+
+bool loadLevels(const std::string &dir, std::vector<Level> &levels, const AssetArchive *archive) {
+    levels.clear();
+    for (int n = 1; ; n++) {
+        std::string name = dir + "/level-" + std::to_string(n);
+        Level level;
+        std::size_t size;
+        const unsigned char *packed = archive ? archive->find(name + ".lvl", size) : nullptr;
+        if (packed) {
+            if (!parseLevel(packed, size, level, nullptr)) return false;
+        } else if (!loadLevel(name + ".lvl", level)) {
+            // A level that has only been edited as text is baked as it loads
+            if (std::ifstream(name + ".lvl")) return false;
+            if (!std::ifstream(name + ".txt")) break;
+            LevelSource source;
+            if (!readLevelText(name + ".txt", level, source) || !bakeLevel(level, source)) return false;
+        }
+        levels.push_back(std::move(level));
+    }
+    return !levels.empty();
+}
+
+bool readLevelText(const std::string &path, Level &level, LevelSource &source) {
+    std::ifstream in(path);
+    if (!in) return false;
+
+    level = Level{};
+    source = LevelSource{};
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string item;
+        if (!(fields >> item) || item[0] == '#') continue;
+        if (item == "texture") {
+            if (!(fields >> level.texture_path)) return false;
+            continue;
+        }
+        float a, b, c;
+        if (!(fields >> a >> b >> c)) return false;
+        std::uint32_t colour = static_cast<std::uint32_t>(a) << 16 | static_cast<std::uint32_t>(b) << 8
+                               | static_cast<std::uint32_t>(c);
+        if (item == "start") {
+            level.start = Pose{a, b, c};
+        } else if (item == "goal") {
+            level.goal = Obstacle{a, b, c};
+        } else if (item == "tree") {
+            source.trees.push_back(Obstacle{a, b, c});
+        } else if (item == "mud") {
+            source.mud.push_back(Obstacle{a, b, c});
+        } else if (item == "tree_colour") {
+            source.palette.tree.push_back(colour);
+        } else if (item == "mud_colour") {
+            source.palette.mud.push_back(colour);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void writeColours(std::ostream &out, const char *item, const std::vector<std::uint32_t> &colours) {
+    for (auto colour : colours) {
+        out << item << " " << (colour >> 16) << " " << (colour >> 8 & 0xff) << " " << (colour & 0xff) << "\n";
+    }
+}
+
+void writeLevelText(std::ostream &out, const Level &level, const LevelSource &source) {
+    out << "texture " << level.texture_path << "\n";
+    out << "start " << level.start.x << " " << level.start.y << " " << level.start.angle << "\n";
+    out << "goal " << level.goal.x << " " << level.goal.y << " " << level.goal.radius << "\n";
+    writeColours(out, "tree_colour", source.palette.tree);
+    writeColours(out, "mud_colour", source.palette.mud);
+    for (const auto &tree : source.trees) {
+        out << "tree " << tree.x << " " << tree.y << " " << tree.radius << "\n";
+    }
+    for (const auto &mud : source.mud) {
+        out << "mud " << mud.x << " " << mud.y << " " << mud.radius << "\n";
+    }
+}
+
+int runLevelTool(int argc, char *argv[]) {
+    std::string tool = argv[1];
+    Level level;
+    LevelSource source;
+    if (tool == "--pack-level" && argc == 4) {
+        if (!readLevelText(argv[2], level, source)) {
+            std::cerr << "cannot read level text " << argv[2] << std::endl;
+            return -1;
+        }
+        if (!bakeLevel(level, source)) {
+            std::cerr << "cannot read level image " << level.texture_path << std::endl;
+            return -1;
+        }
+        if (!saveLevel(argv[3], level, source)) {
+            std::cerr << "cannot write level " << argv[3] << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    if (tool == "--dump-level" && argc == 3) {
+        if (!loadLevel(argv[2], level, &source)) {
+            std::cerr << "cannot read level " << argv[2] << std::endl;
+            return -1;
+        }
+        writeLevelText(std::cout, level, source);
+        return 0;
+    }
+    std::cerr << "usage: sambar --pack-level <text file> <level file> | --dump-level <level file>" << std::endl;
+    return -1;
+}
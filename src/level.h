@@ -0,0 +1,47 @@
+#ifndef SAMBAR_LEVEL_H
+#define SAMBAR_LEVEL_H
+
+#include "archive.h"
+#include "game.h"
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Level files are little endian and 4-byte aligned, so every array is copied straight out of
+// the mapped file:
+//   "SLVL", u32 version, u32 tree count, u32 mud count,
+//   f32 start x, y, rotation, f32 goal x, y, radius, char[64] texture path,
+//   u32 tree colour count, u32 mud colour count,
+//   u32 terrain columns, u32 terrain rows, f32 terrain left, top, texel size,
+//   then f32 x, y, radius for every tree followed by every patch of mud,
+//   the 0xRRGGBB tree colours then mud colours, and one byte per terrain texel, row by row
+
+// What the terrain is baked from: colours picked out of the artwork, and circles stamped onto it
+// on top. Only the level tool keeps these; a game plays on the baked terrain alone
+struct LevelSource
+{
+    TerrainPalette palette;
+    std::vector<Obstacle> trees;
+    std::vector<Obstacle> mud;
+};
+
+// The source is only read back when one is passed
+bool loadLevel(const std::string &path, Level &level, LevelSource *source = nullptr);
+bool saveLevel(const std::string &path, const Level &level, const LevelSource &source);
+// Segment the level image into terrain, then stamp the listed trees and mud and clear the goal
+bool bakeLevel(Level &level, const LevelSource &source);
+// dir/level-1.lvl, dir/level-2.lvl and so on, up to the first one missing, read from the archive
+// when it has them. A level with only a dir/level-n.txt is baked as it loads
+bool loadLevels(const std::string &dir, std::vector<Level> &levels, const AssetArchive *archive = nullptr);
+
+// Editable text form, one item per line:
+//   texture <path>, start <x> <y> <rotation>, goal <x> <y> <radius>,
+//   tree_colour <r> <g> <b>, mud_colour <r> <g> <b>,
+//   tree <x> <y> <radius>, mud <x> <y> <radius> for anything the artwork doesn't show
+bool readLevelText(const std::string &path, Level &level, LevelSource &source);
+void writeLevelText(std::ostream &out, const Level &level, const LevelSource &source);
+
+// sambar --pack-level <text file> <level file> | --dump-level <level file>
+int runLevelTool(int argc, char *argv[]);
+
+#endif
@@ -1,615 +1,426 @@
-#include <SFML/Graphics.hpp>
-#include <box2d/box2d.h>
-#include <random>
+#include "archive.h"
+#include "assets.h"
+#include "batch.h"
+#include "game.h"
+#include "headless.h"
+#include "level.h"
+#include "render.h"
+#include "replay.h"
+#include "stacks.h"
+#include "textures.h"
+#include "world_file.h"
+#include <algorithm>
+#include <iterator>
+#include <fstream>
 #include <string>
-//#include <iostream>
-
-#define WINDOW_WIDTH 800
-#define WINDOW_HEIGHT 600
-
-// Pixels per meter. Box2D uses metric units, so we need to define a conversion
-#define PPM 30.0F
-// SFML uses degrees for angles while Box2D uses radians
-#define DEG_PER_RAD 57.2957795F
-
-// Box2D world for physics simulation, gravity = 9.8 m/s^2
-b2World world(b2Vec2(0, -9.8));
-
-// SFML font for text
-sf::Font font;
-
-int total = 0;
+#include <iostream>
+#include <thread>
+
+sf::Keyboard::Key keys[] {sf::Keyboard::H, sf::Keyboard::J, sf::Keyboard::K,
+                          sf::Keyboard::L, sf::Keyboard::A, sf::Keyboard::D};
+
+// Map a driving key to its control, return false for any other key
+bool controlForKey(sf::Keyboard::Key key, Control &control) {
+    for (int i = 0; i < 6; i++) {
+        if (keys[i] == key) {
+            control = static_cast<Control>(i);
+            return true;
+        }
+    }
+    return false;
+}
 
-// A structure with all we need to render a box
-struct Box
-{
-    float width;
-    float height;
-    sf::Texture texture;
-    b2Body *body;
-};
+// Decoded images turned into textures per frame while the splash shows, so it never stutters
+#define ASSET_UPLOADS_PER_FRAME 2
+// How long the splash waits between checks on assets still loading
+#define SPLASH_POLL_MS 4
 
-struct Sambar
+// Sprites packed into the atlas, in the order they are decoded
+struct SpriteFile
 {
-    float x;
-    float y;
-    float rotation;
-    sf::Texture texture;
+    const char *path;
+    sf::IntRect area;
+    const TextureRegion *Artwork::*sprite;
 };
 
-struct Obstacle
-{
-    float x;
-    float y;
+const SpriteFile sprite_files[] {
+    {"img/basket-1.png", sf::IntRect(0,32,128,128), &Artwork::basket1},
+    {"img/basket-2.png", sf::IntRect(0,32,128,128), &Artwork::basket2},
+    {"img/crate-1.png", sf::IntRect(0,32,128,128), &Artwork::crate1},
+    {"img/crate-2.png", sf::IntRect(0,32,128,128), &Artwork::crate2},
+    {"img/sambar-left.png", sf::IntRect(), &Artwork::sambar_left},
+    {"img/sambar-right.png", sf::IntRect(), &Artwork::sambar_right},
+    {"img/sambar-side.png", sf::IntRect(0,32,128,128), &Artwork::sambar_side},
+    {"img/sambar-top.png", sf::IntRect(), &Artwork::sambar_top},
 };
 
-struct Level
+// Images decoded in the background, waiting to become the atlas and the level textures.
+// The loader holds the sprite files first, then one image per level
+struct AssetStream
 {
-    sf::Texture texture;
-    std::vector<Obstacle> trees;
-    std::vector<Obstacle> mud;
+    const AssetArchive *archive;
+    ImageCache &cache;
+    ImageLoader &images;
+    TextureRegistry &textures;
+    TextureAtlas &atlas;
+    Artwork &art;
+    std::vector<Level> &levels;
+    sf::Font &font;
+    std::size_t next = 0;
+    bool font_loaded = false;
+    bool failed = false;
+    // Started with the stream, to report how long loading took and how much of it was decoding
+    sf::Clock clock{};
 };
 
-struct Artwork
-{
-    sf::Texture basket1;
-    sf::Texture basket2;
-    sf::Texture crate1;
-    sf::Texture crate2;
-    sf::Texture level;
-    sf::Texture sambar_left;
-    sf::Texture sambar_right;
-    sf::Texture sambar_side;
-    sf::Texture sambar_top;
-};
-
-Box createBox(float x, float y, float width, float height, float density, float friction, sf::Texture &texture)
-{
-    // Body definition
-    b2BodyDef boxBodyDef;
-    boxBodyDef.position.Set(x / PPM, y / PPM);
-    boxBodyDef.type = b2_dynamicBody;
-    boxBodyDef.angularDamping = 100000.0f;
-
-    // Shape definition
-    b2PolygonShape boxShape;
-    boxShape.SetAsBox(width / 2 / PPM, height / 2 / PPM);
-
-    // Fixture definition
-    b2FixtureDef fixtureDef;
-    fixtureDef.density = density;
-    fixtureDef.friction = friction;
-    fixtureDef.shape = &boxShape;
-
-    // Now we have a body for our Box object
-    b2Body *boxBody = world.CreateBody(&boxBodyDef);
-    // Lastly, assign the fixture
-    boxBody->CreateFixture(&fixtureDef);
-
-    return Box { width, height, texture, boxBody };
-}
-
-void destroyBox(b2Body* box) {
-    world.DestroyBody(box);
-}
-
-Box createGround(float x, float y, float width, float height, sf::Texture &texture)
-{
-    // Static body definition
-    b2BodyDef groundBodyDef;
-    groundBodyDef.position.Set(x / PPM, y / PPM);
-
-    // Shape definition
-    b2PolygonShape groundBox;
-    groundBox.SetAsBox(width / 2 / PPM, height / 2 / PPM);
-
-    // Now we have a body for our Box object
-    b2Body *groundBody = world.CreateBody(&groundBodyDef);
-    // For a static body, we don't need a custom fixture definition, this will do:
-    groundBody->CreateFixture(&groundBox, 0.0f);
-
-    return Box{ width, height, texture, groundBody };
-}
-
-// return true if box struck the ground
-bool render(sf::RenderWindow &w, sf::View &side, sf::View &top, std::vector<Box> &boxes, Sambar &sambar, Level &level)
-{
-    // Side view - first box is ground, last box is a sambar
-    side.setCenter(sf::Vector2f(boxes.back().body->GetPosition().x * PPM, 0.5f * WINDOW_HEIGHT));
-    w.setView(side);
-    w.clear(sf::Color(64,64,64));
-    sf::RectangleShape sky(sf::Vector2f(WINDOW_WIDTH*0.3, WINDOW_HEIGHT*0.8));
-    sky.setPosition(boxes.back().body->GetPosition().x * PPM - WINDOW_WIDTH*0.15, 0);
-    sky.setFillColor(sf::Color::Cyan);
-    w.draw(sky);
-    b2Body* ground = boxes.front().body;
-    b2Body* truck = boxes.back().body;
-
-    for (const auto &box : boxes)
-    {
-        sf::Sprite rect;
-
-        // For the correct Y coordinate of our drawable rect, we must substract from WINDOW_HEIGHT
-        // because SFML uses OpenGL coordinate system where X is right, Y is down
-        // while Box2D uses traditional X is right, Y is up
-        rect.setPosition(box.body->GetPosition().x * PPM, WINDOW_HEIGHT - (box.body->GetPosition().y * PPM));
-
-        // We also need to set our drawable's origin to its center
-        // because in SFML, "position" refers to the upper left corner
-        // while in Box2D, "position" refers to the body's center
-        rect.setOrigin(box.width / 2, box.height / 2);
-
-        // For the rect to be rotated in the crrect direction, we have to multiply by -1
-        rect.setRotation(-1 * box.body->GetAngle() * DEG_PER_RAD);
-
-        rect.setTexture(box.texture);
-        w.draw(rect);
-
-        // Check if we dropped a box
-        if (box.body == ground || box.body == truck) {
+// Take in up to ASSET_UPLOADS_PER_FRAME more assets, return true once everything is loaded
+static bool streamAssets(AssetStream &assets) {
+    const std::size_t n_sprites = std::size(sprite_files);
+    for (int uploads = 0; uploads < ASSET_UPLOADS_PER_FRAME; uploads++) {
+        if (!assets.font_loaded) {
+            loadFont(assets.archive, "img/FreeMonoBold.ttf", assets.font);
+            assets.font_loaded = true;
             continue;
         }
-        b2ContactEdge* edge = box.body->GetContactList();
-        while (edge != nullptr) {
-            if (edge->other == ground) {
-                return true;
-            }
-            edge = edge->next;
+        if (assets.next == assets.images.size()) break;
+        if (!assets.images.ready(assets.next)) return false;
+
+        const sf::Image *image = assets.images.image(assets.next);
+        const std::string &path = assets.images.path(assets.next);
+        if (image && assets.next < n_sprites) {
+            const SpriteFile &file = sprite_files[assets.next];
+            // Already cropped to the sprite by the loader
+            assets.art.*file.sprite = assets.atlas.add(path, *image);
+            // Pack and upload the atlas as soon as its last sprite is in
+            assets.failed = !(assets.art.*file.sprite) || (assets.next + 1 == n_sprites && !assets.atlas.build());
+        } else if (image) {
+            Level &level = assets.levels[assets.next - n_sprites];
+            level.texture = assets.textures.add(path, *image);
+            assets.failed = !level.texture;
+        } else {
+            assets.failed = true;
+        }
+        if (assets.failed) return false;
+        if (++assets.next == assets.images.size()) {
+            const ImageCache::Stats &stats = assets.cache.stats();
+            std::cout << "assets loaded after " << assets.clock.getElapsedTime().asMilliseconds() << " ms: "
+                      << stats.hits << " images from cache in " << stats.hit_us / 1000.0 << " ms, "
+                      << stats.decoded << " decoded in " << stats.decode_us / 1000.0 << " ms" << std::endl;
+            // Keep what was decoded for next time, if the game's directory can be written to
+            assets.cache.save();
         }
     }
-
-    std::string banner{"SCORE: "};
-    banner += std::to_string(total);
-    sf::Text text(banner, font);
-    text.setLetterSpacing(1.3);
-    text.setCharacterSize(72);
-    text.setOutlineThickness(2.0);
-    w.draw(text);
-
-    // Level map
-    w.setView(top);
-    top.setCenter(sf::Vector2f(0.5f * WINDOW_WIDTH, 0.5f * WINDOW_HEIGHT));
-
-    sf::Sprite map;
-    map.setPosition(0.5f * WINDOW_WIDTH, 0.5f * WINDOW_HEIGHT);
-    map.setScale(1.8f, 1.8f);
-    map.setOrigin(160,160);
-    map.setTexture(level.texture);
-    w.draw(map);
-
-    // Top view
-    sf::Sprite samsprite;
-    samsprite.setPosition(sambar.x, WINDOW_HEIGHT - sambar.y);
-    samsprite.setOrigin(16, 16);
-    samsprite.setRotation(sambar.rotation);
-    samsprite.setTexture(sambar.texture);
-    w.draw(samsprite);
-
-    // Debug - tree view
-    for (const auto &tree : level.trees) {
-        sf::CircleShape circ(20.0);
-        circ.setPosition(sf::Vector2f(tree.x, WINDOW_HEIGHT - tree.y));
-        circ.setOrigin(20, 20);
-        circ.setFillColor(sf::Color::Green);
-//        w.draw(circ);
-    }
-
-    // Debug - mud view
-    for (const auto &mud : level.mud) {
-        sf::CircleShape circ(40.0);
-        circ.setPosition(sf::Vector2f(mud.x, WINDOW_HEIGHT - mud.y));
-        circ.setOrigin(40,40);
-        circ.setFillColor(sf::Color::Yellow);
-//        w.draw(circ);
-    }
-
-    w.display();
-
-    return false;
+    return assets.next == assets.images.size();
 }
 
-bool reachedGoal(Sambar &sambar) {
-    float x = sambar.x - WINDOW_WIDTH + 145;
-    float y = sambar.y - 30;
-    float dist = std::sqrt(x*x + y*y);  
-//    std::cout << "x: " << sambar.x << " y:" << sambar.y << std::endl;
-    return dist < 30.0;
-}
+// Show the splash screen while assets stream in, until they are all loaded and, if wait_for_key,
+// a key has been pressed. Returns false if the window was closed or an asset failed to load
+static bool showSplash(sf::RenderWindow &window, const sf::Texture &texture, AssetStream &assets, bool wait_for_key) {
+    window.setView(window.getDefaultView());
+    sf::Sprite splash;
+    splash.setPosition(0.5*WINDOW_WIDTH, 0.5*WINDOW_HEIGHT);
+    splash.setOrigin(0.5*WINDOW_WIDTH, 0.5*WINDOW_HEIGHT);
+    splash.setTexture(texture);
+    bool key_pressed = !wait_for_key;
+    bool loaded = false;
+    // The splash never changes by itself, so it is only drawn again when the window needs it
+    bool redraw = true;
+    while (window.isOpen() && !(key_pressed && loaded))
+    {
+        if (redraw) {
+            window.clear();
+            window.draw(splash);
+            window.display();
+            redraw = false;
+        }
+        // Once everything is in, nothing can happen until an event comes, so sleep on the queue
+        sf::Event event;
+        bool have_event = loaded ? window.waitEvent(event) : window.pollEvent(event);
+        for (; have_event; have_event = window.pollEvent(event)) {
+            if (event.type == sf::Event::Closed)
+                window.close();
+            if (event.type == sf::Event::Resized || event.type == sf::Event::GainedFocus)
+                redraw = true;
 
-bool struckTree(Sambar &sambar, Level &level) {
-    for (auto & tree : level.trees) {
-        float x = sambar.x - tree.x;
-        float y = sambar.y - tree.y;
-        float dist = std::sqrt(x*x + y*y);  
-        if (dist < 20.0) return true;
+            if (event.type == sf::Event::KeyPressed) {
+                key_pressed = true;
+                break;
+            }
+        }
+        if (loaded) continue;
+
+        // Only after the frame is up, so the first one never waits on loading
+        std::size_t next = assets.next;
+        loaded = streamAssets(assets);
+        if (assets.failed) return false;
+        // Nothing was ready yet, so give the loader threads a moment rather than spinning
+        if (!loaded && assets.next == next) sf::sleep(sf::milliseconds(SPLASH_POLL_MS));
     }
-    return false;
+    return window.isOpen();
 }
 
-bool struckMud(Sambar &sambar, Level &level) {
-    for (auto & mud : level.mud) {
-        float x = sambar.x - mud.x;
-        float y = sambar.y - mud.y;
-        float dist = std::sqrt(x*x + y*y);  
-        if (dist < 40.0) return true;
-    }
-    return false;
+// Hand the simulation as it stands to the drawing thread
+static void publishFrame(TripleBuffer<FrameSnapshot> &snapshots, Simulation &sim, const Renderer &renderer,
+                         float view_half_width) {
+    takeSnapshot(snapshots.back(), sim, view_half_width);
+    snapshots.back().show_terrain = renderer.show_terrain;
+    snapshots.publish();
 }
 
-void runLevel(sf::RenderWindow &window, sf::View &topview, sf::View &sideview, int n_boxes, Artwork &art, Level &level) {
-    std::random_device rd{};
-    std::mt19937 gen{rd()};
-    std::uniform_int_distribution<> d{0, 1000}; 
-    float sambar_density = 800.f;
-
-    // Container to hold all the boxes we create
-    std::vector<Box> boxes;
-    
-    // Generate ground
-    boxes.push_back(createGround(350, 80, 50000, 100, art.crate1));
-    
-    // Generate a lot of boxes
-    sf::Texture *box_textures[] {&art.crate1, &art.crate2, &art.basket1, &art.basket2};
-    for (int i = 0; i < n_boxes; i++)
-    {
-        // Starting positions are randomly generated: x between 74 and 86, y between 270 and 55*n boxes
-        auto &&box = createBox(80 + (d(gen) % 6),
-                               270 + (d(gen) % (72*n_boxes - 270 + 1)),
-                               32,
-                               24,
-                               80.f,
-                               0.7f,
-                               *box_textures[(d(gen)) % 4]);
-        boxes.push_back(box);
-    }
-    
-    // Create a sambar box
-    auto &&sambar = createBox(90, 200, 72, 30, sambar_density, 0.7f, art.sambar_side);
-    sambar.height = 64;
-    boxes.push_back(sambar);
-    
-    // Create a sambar from above
-    Sambar sambar_top {.x = 155.0,
-                       .y = 520.0,
-                       .rotation = 180.0,
-                       .texture = art.sambar_top};
-    
-
-    float fast = 10000.0;
-    float reckless = 13000.0;
-    float heave = 370000.0;
-    float squat = 500000.0;
-
-    float force = 0.f;
-    float angular_impulse = 0.f;
+// Play one level, from the keyboard or from playback if given. Controls are recorded into run
+void runLevel(Renderer &renderer, Artwork &art, Simulation &sim, Level &level, ReplayRun &run,
+              const ReplayRun *playback) {
+    sf::RenderWindow &window = renderer.window;
+    startLevel(sim, level, run.n_boxes, run.seed, art, run.stack);
+    rememberPoses(sim);
+
+    ReplayCursor cursor{.run = playback};
+    Controls controls;
     float rotation = 0.f;
-    bool struck_ground = false;
-    bool reached_goal = false;
-    while (window.isOpen() && !struck_ground && !reached_goal)
+    Outcome outcome = Outcome::Running;
+    long step = 0;
+    long last_step = playback ? playback->steps : -1;
+
+    // Drawing runs on a thread of its own, from snapshots published after each batch of steps,
+    // while this thread keeps the window's events and the physics
+    float view_half_width = 0.5f * renderer.side.getSize().x;
+    TripleBuffer<FrameSnapshot> snapshots;
+    publishFrame(snapshots, sim, renderer, view_half_width);
+    std::atomic<bool> drawing{true};
+    window.setActive(false);
+    std::thread drawer(drawFrames, std::ref(renderer), std::ref(snapshots), std::cref(drawing));
+
+    // Physics advances in fixed steps for however much wall time has passed,
+    // and the drawing thread interpolates between the last two
+    sf::Clock clock;
+    float accumulator = 0.f;
+    // The window is only closed once the drawing thread is done with it
+    bool closed = false;
+    // Without focus nothing steps, and this thread sleeps on the event queue until focus or input returns
+    bool paused = false;
+    // R asks for the level again with the same stack, from the next step
+    bool retry = false;
+    while (!closed && outcome == Outcome::Running && step != last_step)
     {
+        // Sleeping out a pause isn't input handling, so only polling is timed
+        Profiler *input_profiler = paused ? nullptr : sim.profiler;
+        ProfileTime zone_start = profileStart(input_profiler);
         sf::Event event;
-        while (window.pollEvent(event))
+        bool have_event = paused ? window.waitEvent(event) : window.pollEvent(event);
+        for (; have_event; have_event = window.pollEvent(event))
         {
+            Control control;
             if (event.type == sf::Event::Closed)
-                window.close();
-            if (event.type == sf::Event::KeyPressed) {
-                switch(event.key.code) {
-                    case sf::Keyboard::H:
-                        // Strong reverse
-                        force = -reckless;
-                        angular_impulse = -squat;
-                        break;
-                    case sf::Keyboard::J:
-                        // Reverse
-                        force = -fast;
-                        angular_impulse = -heave;
-                        break;
-                    case sf::Keyboard::K:
-                        // Forward
-                        force = fast;
-                        angular_impulse = heave;
-                        break;
-                    case sf::Keyboard::L:
-                        // Strong forward
-                        force = reckless;
-                        angular_impulse = squat;
-                        break;
-                    case sf::Keyboard::A:
-                        // Left turn
-                        sambar_top.texture = art.sambar_left;
-                        rotation = -4.f;
-                        break;
-                    case sf::Keyboard::D:
-                        // Right turn
-                        sambar_top.texture = art.sambar_right;
-                        rotation = 4.f;
-                        break;
-                }
-            } else if (event.type == sf::Event::KeyReleased) {
-                switch(event.key.code) {
-                    case sf::Keyboard::A:
-                    case sf::Keyboard::D:
-                        // No turn
-                        sambar_top.texture = art.sambar_top;
-                        rotation = 0.f;
-                        break;
-                    case sf::Keyboard::H:
-                        // Strong reverse if it was most recently pressed
-                        force = force == -reckless ? 0 : force;
-                        angular_impulse = angular_impulse == -squat ? 0 : angular_impulse;
-                        break;
-                    case sf::Keyboard::J:
-                        // Reverse if it was most recently pressed
-                        force = force == -fast ? 0 : force;
-                        angular_impulse = angular_impulse == -heave ? 0 : angular_impulse;
-                        break;
-                    case sf::Keyboard::K:
-                        // Forward if it was most recently pressed
-                        force = force == fast ? 0 : force;
-                        angular_impulse = angular_impulse == heave ? 0 : angular_impulse;
-                        break;
-                    case sf::Keyboard::L:
-                        // Strong forward if it was most recently pressed
-                        force = force == reckless ? 0 : force;
-                        angular_impulse = angular_impulse == squat ? 0 : angular_impulse;
-                        break;
+                closed = true;
+            if (event.type == sf::Event::LostFocus)
+                paused = true;
+            if (paused && (event.type == sf::Event::GainedFocus || event.type == sf::Event::KeyPressed
+                           || event.type == sf::Event::MouseButtonPressed)) {
+                // Pick up from here rather than catching up on the time away
+                paused = false;
+                clock.restart();
+            }
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F3) {
+                renderer.show_terrain = !renderer.show_terrain;
+                publishFrame(snapshots, sim, renderer, view_half_width);
+            }
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F5) {
+                // Save the world as it is, to attach to a bug report or replay with --headless --world
+                std::string path = "world-" + std::to_string(run.seed) + "-" + std::to_string(step) + ".swld";
+                if (saveWorld(path, sim, art, run.level)) {
+                    std::cout << "saved world to " << path << std::endl;
+                } else {
+                    std::cerr << "cannot save world to " << path << std::endl;
                 }
             }
+            if (event.type == sf::Event::Resized) {
+                publishFrame(snapshots, sim, renderer, view_half_width);
+            }
+            if (playback) continue;
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::R) {
+                retry = true;
+            }
+            if (event.type == sf::Event::KeyPressed && controlForKey(event.key.code, control)) {
+                pressControl(controls, control);
+            } else if (event.type == sf::Event::KeyReleased && controlForKey(event.key.code, control)) {
+                releaseControl(controls, control);
+            }
         }
-        // Apply updates to sambar side
-        sambar.body->ApplyForceToCenter(b2Vec2(force, 10), true);
-        sambar.body->ApplyAngularImpulse(angular_impulse, true);
-    
-        // Apply updates to sambar top
-        sambar_top.rotation += rotation;
-        auto & v = sambar.body->GetLinearVelocity();
-        // We will only use horizontal component, not vertical
-        sambar_top.x += std::sin(sambar_top.rotation / DEG_PER_RAD) * v.x;
-        sambar_top.y += std::cos(sambar_top.rotation / DEG_PER_RAD) * v.x;
-    
-        world.Step(1 / 60.f , 6, 3);
-        if (struckTree(sambar_top, level)) {
-            // instant rebound, timestep 1/60
-            b2Vec2 rebound(-sambar_density * 60. * 2. * sambar.body->GetLinearVelocity());
-            sambar.body->ApplyForceToCenter(rebound, true);
-        }
-        if (struckMud(sambar_top, level)) {
-            // instant slowdown, timestep 1/60
-            b2Vec2 rebound(-sambar_density * 60. * 0.25 * sambar.body->GetLinearVelocity());
-            sambar.body->ApplyForceToCenter(rebound, true);
-        }
-        reached_goal = reachedGoal(sambar_top);
-        struck_ground = render(window, sideview, topview, boxes, sambar_top, level);
+        profileEnd(input_profiler, Zone::Input, zone_start);
+        if (paused) continue;
+
+        // Don't try to catch up on a long stall, just let the game slow down
+        accumulator += std::min(clock.restart().asSeconds(), MAX_FRAME_TIME);
+        int steps = 0;
+        while (accumulator >= TIME_STEP && outcome == Outcome::Running && step != last_step) {
+            if (playback) {
+                controls = replayControls(cursor, step);
+                retry = cursor.retry;
+            }
+            if (retry) {
+                if (!retryLevel(sim)) {
+                    endLevel(sim, Outcome::Running);
+                    startLevel(sim, level, run.n_boxes, run.seed, art, run.stack);
+                }
+                recordRetry(run, step);
+                retry = false;
+            }
 
-        if (reached_goal) total += n_boxes;
-        if (reached_goal || struck_ground) {
-            for (auto & box : boxes) {
-                destroyBox(box.body);
+            // Show the sambar turning while A or D is held
+            if (controls.rotation != rotation) {
+                rotation = controls.rotation;
+                sim.sambar_top.sprite = rotation < 0 ? art.sambar_left
+                                       : rotation > 0 ? art.sambar_right
+                                       : art.sambar_top;
             }
+
+            rememberPoses(sim);
+            recordControls(run, step, controls);
+            outcome = stepLevel(sim, controls);
+            step++;
+            accumulator -= TIME_STEP;
+            if (++steps == MAX_STEPS_PER_FRAME) {
+                accumulator = 0.f;
+            }
+        }
+
+        if (steps > 0) {
+            publishFrame(snapshots, sim, renderer, view_half_width);
         }
+        // Nothing to do until the next step is due
+        sf::sleep(sf::seconds(TIME_STEP - accumulator));
+    }
+
+    // Wake the drawing thread in case it is idle, so it sees it is done
+    drawing = false;
+    publishFrame(snapshots, sim, renderer, view_half_width);
+    drawer.join();
+    window.setActive(true);
+    if (closed) window.close();
+
+    finishRun(run, step, outcome, sim);
+    if (sim.profiler) {
+        std::cout << "level " << run.level + 1 << " boxes " << run.n_boxes << ", latest steps and frames:" << std::endl;
+        printProfile(std::cout, *sim.profiler);
     }
+    // Runs cut short, by the window closing or a playback running out of steps, still give their
+    // bodies back, or the next level would start on top of them
+    endLevel(sim, outcome);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-    font.loadFromFile("img/FreeMonoBold.ttf");
+    if (argc > 1 && std::string(argv[1]) == "--headless") {
+        return runHeadless(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--batch") {
+        return runBatch(argc, argv);
+    }
+    if (argc > 1 && (std::string(argv[1]) == "--pack-level" || std::string(argv[1]) == "--dump-level")) {
+        return runLevelTool(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--pack-assets") {
+        return runPackAssets(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--settle-stacks") {
+        return runSettleStacks(argc, argv);
+    }
+
+    // sambar [--record file | --replay file] [--profile]
+    bool profile = argc > 1 && std::string(argv[argc - 1]) == "--profile";
+    if (profile) argc--;
+    std::ofstream record;
+    std::vector<ReplayRun> playback;
+    if (argc == 3 && std::string(argv[1]) == "--record") {
+        record.open(argv[2], std::ios::binary);
+        if (!writeReplayHeader(record)) return -1;
+    } else if (argc == 3 && std::string(argv[1]) == "--replay") {
+        if (!loadReplay(argv[2], playback)) return -1;
+    } else if (argc > 1) {
+        return -1;
+    }
+
+    // One packed file holds every asset if it has been built, loose files are the fallback
+    AssetArchive archive;
+    const AssetArchive *packed = openAssetArchive(archive, argv[0]) ? &archive : nullptr;
+
+    // Images are decoded once and kept as raw pixels, next to the game, until the PNG changes
+    ImageCache cache(packed, besideProgram(argv[0], IMAGE_CACHE));
+    // Every image is loaded once and shared by whatever draws it
+    TextureRegistry textures(&cache);
+
+    // The splash is the only image decoded before the window opens
+    const sf::Texture *splash_texture = textures.load("img/splash.png");
+    if (!splash_texture) return -1;
+    std::vector<Level> levels;
+    if (!loadLevels("levels", levels, packed)) return -1;
+    // Stacks already settled on the truck, so levels start without the drop
+    StackCache stacks;
+    if (!loadStacks(STACK_FILE, stacks, packed)) return -1;
+
+    // Everything else is decoded on worker threads while the splash shows
+    std::vector<ImageRequest> image_files;
+    for (const auto &file : sprite_files) {
+        image_files.push_back(ImageRequest{file.path, file.area});
+    }
+    for (const auto &level : levels) {
+        image_files.push_back(ImageRequest{level.texture_path, sf::IntRect()});
+    }
+    ImageLoader images(image_files, cache);
+
     sf::RenderWindow window(sf::VideoMode(WINDOW_WIDTH,WINDOW_HEIGHT), "Sambar Scamper");
-    window.setFramerateLimit(60);
+    window.setVerticalSyncEnabled(true);
 
     sf::View sideview(sf::FloatRect(0.f,0.f,0.3*WINDOW_WIDTH-1,1.0*WINDOW_HEIGHT));
     sf::View topview(sf::FloatRect(0.3*WINDOW_WIDTH+1,0.0,0.7*WINDOW_WIDTH,1.0*WINDOW_HEIGHT));
     sideview.setViewport(sf::FloatRect(0.f, 0.f, 0.3f, 1.0f));
     topview.setViewport(sf::FloatRect(0.3f, 0.f, 0.7f, 1.0f));
 
-    sf::Texture splash_texture;
-    if (!splash_texture.loadFromFile("img/splash.png")) return -1;
-
-    sf::Texture sambar_texture;
-    if (!sambar_texture.loadFromFile("img/sambar-side.png", sf::IntRect(0,32,128,128))) return -1;
-
-    sf::Texture sambar_left_texture;
-    if (!sambar_left_texture.loadFromFile("img/sambar-left.png")) return -1;
-
-    sf::Texture sambar_right_texture;
-    if (!sambar_right_texture.loadFromFile("img/sambar-right.png")) return -1;
-
-    sf::Texture sambar_top_texture;
-    if (!sambar_top_texture.loadFromFile("img/sambar-top.png")) return -1;
-
-    sf::Texture crate1_texture;
-    if (!crate1_texture.loadFromFile("img/crate-1.png", sf::IntRect(0,32,128,128))) return -1;
-    
-    sf::Texture crate2_texture;
-    if (!crate2_texture.loadFromFile("img/crate-2.png", sf::IntRect(0,32,128,128))) return -1;
-    
-    sf::Texture basket1_texture;
-    if (!basket1_texture.loadFromFile("img/basket-1.png", sf::IntRect(0,32,128,128))) return -1;
-    
-    sf::Texture basket2_texture;
-    if (!basket2_texture.loadFromFile("img/basket-2.png", sf::IntRect(0,32,128,128))) return -1;
-
-    sf::Texture ground_texture;
-    if (!ground_texture.loadFromFile("img/basket-1.png", sf::IntRect(0,0,128,128))) return -1;
-
-    sf::Texture level1_texture;
-    if (!level1_texture.loadFromFile("img/level-1.png")) return -1;
-
-    sf::Texture level2_texture;
-    if (!level2_texture.loadFromFile("img/level-2.png")) return -1;
-
-    sf::Texture level3_texture;
-    if (!level3_texture.loadFromFile("img/level-3.png")) return -1;
-
-    Artwork art { .basket1 = basket1_texture,
-                  .basket2 = basket2_texture,
-                  .crate1 = crate1_texture,
-                  .crate2 = crate2_texture,
-                  .sambar_left = sambar_left_texture,
-                  .sambar_right = sambar_right_texture,
-                  .sambar_side = sambar_texture,
-                  .sambar_top = sambar_top_texture }; 
-
-    // TODO: store this appropriately
-    Level levels[3];
-    levels[0].texture = level1_texture;
-    levels[0].trees.push_back(Obstacle{199.f, 531.f});
-    levels[0].trees.push_back(Obstacle{372.f, 556.f});
-    levels[0].trees.push_back(Obstacle{515.f, 556.f});
-    levels[0].trees.push_back(Obstacle{659.f, 528.f});
-    levels[0].trees.push_back(Obstacle{313.f, 441.f});
-    levels[0].trees.push_back(Obstacle{480.f, 441.f});
-    levels[0].trees.push_back(Obstacle{629.f, 382.f});
-    levels[0].trees.push_back(Obstacle{199.f, 382.f});
-    levels[0].trees.push_back(Obstacle{400.f, 382.f});
-    levels[0].trees.push_back(Obstacle{198.f, 236.f});
-    levels[0].trees.push_back(Obstacle{313.f, 294.f});
-    levels[0].trees.push_back(Obstacle{514.f, 332.f});
-    levels[0].trees.push_back(Obstacle{459.f, 272.f});
-    levels[0].trees.push_back(Obstacle{256.f, 152.f});
-    levels[0].trees.push_back(Obstacle{430.f, 152.f});
-    levels[0].trees.push_back(Obstacle{511.f, 183.f});
-    levels[0].trees.push_back(Obstacle{660.f, 183.f});
-    levels[0].trees.push_back(Obstacle{545.f, 67.f});
-    levels[0].trees.push_back(Obstacle{426.f, 37.f});
-    levels[0].trees.push_back(Obstacle{285.f, 37.f});
-    levels[0].trees.push_back(Obstacle{142.f, 37.f});
-    levels[0].mud.push_back(Obstacle{210.f, 460.f});
-    levels[0].mud.push_back(Obstacle{210.f, 302.f});
-    levels[0].mud.push_back(Obstacle{210.f, 150.f});
-    levels[0].mud.push_back(Obstacle{305.f, 210.f});
-    levels[0].mud.push_back(Obstacle{305.f, 365.f});
-    levels[0].mud.push_back(Obstacle{415.f, 216.f});
-    levels[0].mud.push_back(Obstacle{230.f, 255.f});
-    levels[0].mud.push_back(Obstacle{642.f, 200.f});
-    levels[0].mud.push_back(Obstacle{210.f, 37.f});
-    levels[0].mud.push_back(Obstacle{428.f, 84.f});
-    levels[0].mud.push_back(Obstacle{519.f, 120.f});
-    levels[0].mud.push_back(Obstacle{289.f, 527.f});
-    levels[0].mud.push_back(Obstacle{521.f, 247.f});
-    levels[0].mud.push_back(Obstacle{644.f, 304.f});
-    levels[0].mud.push_back(Obstacle{522.f, 398.f});
-    levels[0].mud.push_back(Obstacle{599.f, 524.f});
-    levels[1].texture = level2_texture;
-    levels[1].trees.push_back(Obstacle{247.f, 560.f});
-    levels[1].trees.push_back(Obstacle{515.f, 560.f});
-    levels[1].trees.push_back(Obstacle{625.f, 530.f});
-    levels[1].trees.push_back(Obstacle{346.f, 530.f});
-    levels[1].trees.push_back(Obstacle{227.f, 475.f});
-    levels[1].trees.push_back(Obstacle{570.f, 445.f});
-    levels[1].trees.push_back(Obstacle{169.f, 244.f});
-    levels[1].trees.push_back(Obstacle{341.f, 210.f});
-    levels[1].trees.push_back(Obstacle{485.f, 180.f});
-    levels[1].trees.push_back(Obstacle{631.f, 154.f});
-    levels[1].trees.push_back(Obstacle{424.f, 70.f});
-    levels[1].trees.push_back(Obstacle{279.f, 124.f});
-    levels[1].trees.push_back(Obstacle{143.f, 37.f});
-    levels[1].mud.push_back(Obstacle{202.f, 391.f});
-    levels[1].mud.push_back(Obstacle{243.f, 277.f});
-    levels[1].mud.push_back(Obstacle{332.f, 359.f});
-    levels[1].mud.push_back(Obstacle{414.f, 444.f});
-    levels[1].mud.push_back(Obstacle{477.f, 368.f});
-    levels[1].mud.push_back(Obstacle{406.f, 203.f});
-    levels[1].mud.push_back(Obstacle{548.f, 300.f});
-    levels[1].mud.push_back(Obstacle{617.f, 235.f});
-    levels[1].mud.push_back(Obstacle{512.f, 57.f});
-    levels[1].mud.push_back(Obstacle{491.f, 239.f});
-    levels[1].mud.push_back(Obstacle{404.f, 296.f});
-    levels[1].mud.push_back(Obstacle{470.f, 113.f});
-    levels[1].mud.push_back(Obstacle{589.f, 171.f});
-    levels[2].texture = level3_texture;
-    levels[2].trees.push_back(Obstacle{227.f, 556.f});
-    levels[2].trees.push_back(Obstacle{227.f, 500.f});
-    levels[2].trees.push_back(Obstacle{201.f, 443.f});
-    levels[2].trees.push_back(Obstacle{201.f, 382.f});
-    levels[2].trees.push_back(Obstacle{255.f, 414.f});
-    levels[2].trees.push_back(Obstacle{255.f, 354.f});
-    levels[2].trees.push_back(Obstacle{343.f, 500.f});
-    levels[2].trees.push_back(Obstacle{343.f, 442.f});
-    levels[2].trees.push_back(Obstacle{400.f, 413.f});
-    levels[2].trees.push_back(Obstacle{427.f, 471.f});
-    levels[2].trees.push_back(Obstacle{513.f, 500.f});
-    levels[2].trees.push_back(Obstacle{489.f, 411.f});
-    levels[2].trees.push_back(Obstacle{456.f, 353.f});
-    levels[2].trees.push_back(Obstacle{490.f, 300.f});
-    levels[2].trees.push_back(Obstacle{395.f, 300.f});
-    levels[2].trees.push_back(Obstacle{343.f, 270.f});
-    levels[2].trees.push_back(Obstacle{230.f, 155.f});
-    levels[2].trees.push_back(Obstacle{287.f, 99.f});
-    levels[2].trees.push_back(Obstacle{319.f, 154.f});
-    levels[2].trees.push_back(Obstacle{370.f, 184.f});
-    levels[2].trees.push_back(Obstacle{460.f, 90.f});
-    levels[2].trees.push_back(Obstacle{543.f, 185.f});
-    levels[2].trees.push_back(Obstacle{164.f, 584.f});
-    levels[2].trees.push_back(Obstacle{282.f, 584.f});
-    levels[2].trees.push_back(Obstacle{340.f, 584.f});
-    levels[2].trees.push_back(Obstacle{398.f, 584.f});
-    levels[2].trees.push_back(Obstacle{456.f, 584.f});
-    levels[2].trees.push_back(Obstacle{510.f, 584.f});
-    levels[2].trees.push_back(Obstacle{568.f, 584.f});
-    levels[2].trees.push_back(Obstacle{141.f, 267.f});
-    levels[2].trees.push_back(Obstacle{141.f, 40.f});
-    levels[2].trees.push_back(Obstacle{433.f, 40.f});
-    levels[2].trees.push_back(Obstacle{485.f, 40.f});
-    levels[2].trees.push_back(Obstacle{545.f, 12.f});
-    levels[2].trees.push_back(Obstacle{373.f, 12.f});
-    levels[2].trees.push_back(Obstacle{312.f, 12.f});
-    levels[2].trees.push_back(Obstacle{257.f, 12.f});
-    levels[2].trees.push_back(Obstacle{199.f, 12.f});
-    levels[2].trees.push_back(Obstacle{121.f, 90.f});
-    levels[2].trees.push_back(Obstacle{121.f, 180.f});
-    levels[2].trees.push_back(Obstacle{121.f, 324.f});
-    levels[2].trees.push_back(Obstacle{121.f, 383.f});
-    levels[2].trees.push_back(Obstacle{121.f, 440.f});
-    levels[2].trees.push_back(Obstacle{121.f, 498.f});
-    levels[2].trees.push_back(Obstacle{121.f, 553.f});
-    levels[2].trees.push_back(Obstacle{599.f, 381.f});
-    levels[2].trees.push_back(Obstacle{599.f, 152.f});
-    levels[2].trees.push_back(Obstacle{630.f, 95.f});
-    levels[2].trees.push_back(Obstacle{630.f, 213.f});
-    levels[2].trees.push_back(Obstacle{630.f, 330.f});
-    levels[2].trees.push_back(Obstacle{630.f, 442.f});
-    levels[2].trees.push_back(Obstacle{630.f, 556.f});
-    levels[2].trees.push_back(Obstacle{658.f, 500.f});
-    levels[2].trees.push_back(Obstacle{658.f, 386.f});
-    levels[2].trees.push_back(Obstacle{658.f, 270.f});
-    levels[2].trees.push_back(Obstacle{658.f, 154.f});
-    levels[2].mud.push_back(Obstacle{233.f,253.f});
-    levels[2].mud.push_back(Obstacle{455.f,198.f});
-
-
-    while (window.isOpen()) {
-        // Display splash
-        window.setView(window.getDefaultView());
-        sf::Sprite splash;
-        splash.setPosition(0.5*WINDOW_WIDTH, 0.5*WINDOW_HEIGHT);
-        splash.setOrigin(0.5*WINDOW_WIDTH, 0.5*WINDOW_HEIGHT);
-        splash.setTexture(splash_texture);
-        bool key_pressed = false;
-        while (window.isOpen() && !key_pressed)
-        {
-            window.clear();
-            window.draw(splash);
-            window.display();
-            sf::Event event;
-            while (window.pollEvent(event)){
-                if (event.type == sf::Event::Closed)
-                    window.close();
-
-                if (event.type == sf::Event::KeyPressed) {
-                    key_pressed = true;
-                    break;
-                }
-            }
-        }
+    // SFML font for text
+    sf::Font font;
+    // Side-view and sambar sprites share one atlas, so each view draws them in one batch
+    TextureAtlas atlas;
+    Artwork art;
+    AssetStream assets{packed, cache, images, textures, atlas, art, levels, font};
+
+    // Splash first, with the player reading it while the rest loads. A replay starts as soon as it can
+    if (!showSplash(window, *splash_texture, assets, playback.empty())) {
+        return assets.failed ? -1 : 0;
+    }
 
+    Renderer renderer{window, sideview, topview, &atlas.getTexture()};
+    setupHud(renderer.hud, font);
+    Simulation sim;
+    sim.stacks = &stacks;
+    // Physics, input and drawing timings, reported after each level
+    Profiler profiler;
+    if (profile) {
+        sim.profiler = &profiler;
+        renderer.profiler = &profiler;
+    }
+
+    // Play back a recording and quit
+    for (auto &recorded : playback) {
+        if (!validRun(recorded, levels.size(), stacks)) return -1;
+        ReplayRun run{.seed = recorded.seed, .level = recorded.level, .n_boxes = recorded.n_boxes,
+                      .stack = recorded.stack};
+        runLevel(renderer, art, sim, levels[recorded.level], run, &recorded);
+    }
+    if (!playback.empty()) return 0;
+
+    std::random_device rd{};
+    do {
         // Execute levels
-        for (int n_level = 0; n_level < 3; n_level++) {
-            int n_boxes = 2;
-            while (window.isOpen() && n_boxes < 12) {
-                runLevel(window, topview, sideview, n_boxes++, art, levels[n_level]);
+        for (int n_level = 0; n_level < static_cast<int>(levels.size()); n_level++) {
+            int n_boxes = MIN_BOXES;
+            while (window.isOpen() && n_boxes <= MAX_BOXES) {
+                ReplayRun run{.seed = rd(), .level = n_level, .n_boxes = n_boxes++};
+                run.stack = pickStack(stacks, run.n_boxes, run.seed);
+                runLevel(renderer, art, sim, levels[n_level], run, nullptr);
+                if (record.is_open()) writeReplayRun(record, run);
             }
         }
-    }
+    } while (showSplash(window, *splash_texture, assets, true));
 
     return 0;
 }
@@ -0,0 +1,31 @@
+#ifndef SAMBAR_MAPPED_FILE_H
+#define SAMBAR_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory map of a whole file, unmapped when closed or destroyed
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    bool open(const std::string &path);
+    void close();
+
+    const unsigned char *data() const { return bytes; }
+    std::size_t size() const { return length; }
+
+private:
+    const unsigned char *bytes = nullptr;
+    std::size_t length = 0;
+#ifdef _WIN32
+    void *file = nullptr;
+    void *mapping = nullptr;
+#endif
+};
+
+#endif
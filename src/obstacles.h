@@ -0,0 +1,11 @@
+#ifndef SAMBAR_OBSTACLES_H
+#define SAMBAR_OBSTACLES_H
+
+struct Obstacle
+{
+    float x;
+    float y;
+    float radius;
+};
+
+#endif
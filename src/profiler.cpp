@@ -0,0 +1,69 @@
+#include "profiler.h"
+#include "game.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <vector>
+
+static const char *zone_names[] {"step", "collide", "solve", "solve init", "solve velocity", "solve position",
+                                 "broadphase", "solve TOI", "input", "top-down", "obstacles", "render", "display"};
+static_assert(std::size(zone_names) == static_cast<std::size_t>(Zone::Count), "every zone needs a name");
+
+void profileSample(Profiler &profiler, Zone zone, float ms) {
+    ProfileRing &ring = profiler.zones[static_cast<std::size_t>(zone)];
+    ring.samples[ring.next] = ms;
+    ring.next = (ring.next + 1) % PROFILE_SAMPLES;
+    ring.count = std::min<std::size_t>(ring.count + 1, PROFILE_SAMPLES);
+}
+
+void profileEnd(Profiler *profiler, Zone zone, ProfileTime start) {
+    if (!profiler) return;
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    profileSample(*profiler, zone, elapsed.count());
+}
+
+void profileStep(Profiler &profiler, const b2Profile &step) {
+    profileSample(profiler, Zone::Step, step.step);
+    profileSample(profiler, Zone::Collide, step.collide);
+    profileSample(profiler, Zone::Solve, step.solve);
+    profileSample(profiler, Zone::SolveInit, step.solveInit);
+    profileSample(profiler, Zone::SolveVelocity, step.solveVelocity);
+    profileSample(profiler, Zone::SolvePosition, step.solvePosition);
+    profileSample(profiler, Zone::Broadphase, step.broadphase);
+    profileSample(profiler, Zone::SolveTOI, step.solveTOI);
+}
+
+ProfileStats zoneStats(const Profiler &profiler, Zone zone) {
+    const ProfileRing &ring = profiler.zones[static_cast<std::size_t>(zone)];
+    ProfileStats stats;
+    stats.count = ring.count;
+    if (ring.count == 0) return stats;
+
+    // Nearest rank on a sorted copy, the ring itself stays in arrival order
+    std::vector<float> sorted(ring.samples.begin(), ring.samples.begin() + ring.count);
+    std::sort(sorted.begin(), sorted.end());
+    auto rank = [&](float p) { return sorted[std::max<std::size_t>(std::ceil(p * sorted.size()), 1) - 1]; };
+    stats.p50 = rank(0.50f);
+    stats.p95 = rank(0.95f);
+    stats.p99 = rank(0.99f);
+    stats.max = sorted.back();
+    return stats;
+}
+
+void printProfile(std::ostream &out, const Profiler &profiler) {
+    float budget = TIME_STEP * 1000.f;
+    out << std::left << std::setw(16) << "zone" << std::right << std::setw(9) << "p50 ms" << std::setw(9) << "p95 ms"
+        << std::setw(9) << "p99 ms" << std::setw(9) << "max ms" << std::setw(9) << "budget" << std::setw(9) << "samples"
+        << std::endl;
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    for (std::size_t i = 0; i < std::size(zone_names); i++) {
+        ProfileStats stats = zoneStats(profiler, static_cast<Zone>(i));
+        if (stats.count == 0) continue;
+        out << std::left << std::setw(16) << zone_names[i] << std::right << std::setw(9) << stats.p50
+            << std::setw(9) << stats.p95 << std::setw(9) << stats.p99 << std::setw(9) << stats.max
+            << std::setw(8) << std::setprecision(2) << 100.f * stats.p50 / budget << "%" << std::setprecision(3)
+            << std::setw(9) << stats.count << std::endl;
+    }
+    out.flags(flags);
+}
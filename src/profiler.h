@@ -0,0 +1,72 @@
+#ifndef SAMBAR_PROFILER_H
+#define SAMBAR_PROFILER_H
+
+#include <box2d/box2d.h>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+
+// Samples kept per zone, 10 s of steps at 60 per second. Older ones are overwritten
+#define PROFILE_SAMPLES 600
+
+// Phases timed every step or frame: Box2D's own, as b2Profile reports them, then ours
+enum class Zone
+{
+    Step,
+    Collide,
+    Solve,
+    SolveInit,
+    SolveVelocity,
+    SolvePosition,
+    Broadphase,
+    SolveTOI,
+    Input,
+    TopDown,
+    Obstacles,
+    Render,
+    Display,
+    Count
+};
+
+// The latest PROFILE_SAMPLES timings of one zone, in milliseconds
+struct ProfileRing
+{
+    std::array<float, PROFILE_SAMPLES> samples{};
+    std::size_t next = 0;
+    std::size_t count = 0;
+};
+
+// Every zone has a single writer: render and display belong to the drawing thread and the rest
+// to the thread stepping the world. Read the stats once both are done with it
+struct Profiler
+{
+    std::array<ProfileRing, static_cast<std::size_t>(Zone::Count)> zones;
+};
+
+struct ProfileStats
+{
+    float p50 = 0.f;
+    float p95 = 0.f;
+    float p99 = 0.f;
+    float max = 0.f;
+    std::size_t count = 0;
+};
+
+typedef std::chrono::steady_clock::time_point ProfileTime;
+
+// Start timing a zone, reading the clock only when there is a profiler to record into
+inline ProfileTime profileStart(const Profiler *profiler) {
+    return profiler ? std::chrono::steady_clock::now() : ProfileTime{};
+}
+// Record the time since start into zone
+void profileEnd(Profiler *profiler, Zone zone, ProfileTime start);
+void profileSample(Profiler &profiler, Zone zone, float ms);
+// Record every phase of the world's latest step
+void profileStep(Profiler &profiler, const b2Profile &step);
+
+ProfileStats zoneStats(const Profiler &profiler, Zone zone);
+// One line per zone with samples: its percentiles, max and median share of the step's time budget
+void printProfile(std::ostream &out, const Profiler &profiler);
+
+#endif
@@ -0,0 +1,147 @@
+#include "render.h"
+#include <algorithm>
+#include <chrono>
+
+// Add a sprite-like quad for region, placed the way sf::Sprite would place it
+static void appendQuad(sf::VertexArray &quads, const TextureRegion &region,
+                       sf::Vector2f position, sf::Vector2f origin, float rotation) {
+    sf::Transform t;
+    t.translate(position.x, position.y).rotate(rotation).translate(-origin.x, -origin.y);
+    float w = region.rect.width;
+    float h = region.rect.height;
+    float u = region.rect.left;
+    float v = region.rect.top;
+    quads.append(sf::Vertex(t.transformPoint(0, 0), sf::Vector2f(u, v)));
+    quads.append(sf::Vertex(t.transformPoint(w, 0), sf::Vector2f(u + w, v)));
+    quads.append(sf::Vertex(t.transformPoint(w, h), sf::Vector2f(u + w, v + h)));
+    quads.append(sf::Vertex(t.transformPoint(0, h), sf::Vector2f(u, v + h)));
+}
+
+// Tint every tree and mud texel of the terrain mask
+static void drawTerrain(sf::RenderTarget &target, const TerrainMask &mask) {
+    sf::VertexArray texels(sf::Quads);
+    for (int row = 0; row < mask.rows; row++) {
+        for (int column = 0; column < mask.columns; column++) {
+            Terrain terrain = mask.texels[row * mask.columns + column];
+            if (terrain == Terrain::Clear) continue;
+            sf::Color colour = terrain == Terrain::Tree ? sf::Color(0, 255, 0, 96) : sf::Color(255, 255, 0, 96);
+            float x = mask.left + column * mask.texel_size;
+            float y = WINDOW_HEIGHT - (mask.top - row * mask.texel_size);
+            float s = mask.texel_size;
+            texels.append(sf::Vertex(sf::Vector2f(x, y), colour));
+            texels.append(sf::Vertex(sf::Vector2f(x + s, y), colour));
+            texels.append(sf::Vertex(sf::Vector2f(x + s, y + s), colour));
+            texels.append(sf::Vertex(sf::Vector2f(x, y + s), colour));
+        }
+    }
+    target.draw(texels);
+}
+
+// Draw everything in the top view that stays put for the whole level
+static bool buildTopLayer(Renderer &r, const Level &level, bool show_terrain) {
+    sf::Vector2u size(r.top.getSize());
+    if (r.top_layer.getSize() != size && !r.top_layer.create(size.x, size.y)) {
+        return false;
+    }
+    r.top_layer.setView(sf::View(sf::Vector2f(0.5f * WINDOW_WIDTH, 0.5f * WINDOW_HEIGHT), r.top.getSize()));
+    // Same grey as the window behind it
+    r.top_layer.clear(sf::Color(64,64,64));
+
+    sf::Sprite map;
+    map.setPosition(0.5f * WINDOW_WIDTH, 0.5f * WINDOW_HEIGHT);
+    map.setScale(MAP_SCALE, MAP_SCALE);
+    map.setOrigin(0.5f * level.texture->getSize().x, 0.5f * level.texture->getSize().y);
+    map.setTexture(*level.texture);
+    r.top_layer.draw(map);
+    if (show_terrain) {
+        drawTerrain(r.top_layer, level.terrain);
+    }
+
+    r.top_layer.display();
+    r.layer_level = &level;
+    r.layer_terrain = show_terrain;
+    return true;
+}
+
+void render(Renderer &r, const FrameSnapshot &frame, float alpha)
+{
+    sf::RenderWindow &w = r.window;
+    sf::View &side = r.side;
+    sf::View &top = r.top;
+    const Level &level = *frame.level;
+    ProfileTime zone_start = profileStart(r.profiler);
+
+    // Side view - first box is ground, last box is a sambar
+    Pose truck = blendPose(frame.truck_previous, frame.truck_current, alpha);
+    side.setCenter(sf::Vector2f(truck.x * PPM, 0.5f * WINDOW_HEIGHT));
+    w.setView(side);
+    w.clear(sf::Color(64,64,64));
+    sf::RectangleShape sky(sf::Vector2f(WINDOW_WIDTH*0.3, WINDOW_HEIGHT*0.8));
+    sky.setPosition(truck.x * PPM - WINDOW_WIDTH*0.15, 0);
+    sky.setFillColor(sf::Color::Cyan);
+    w.draw(sky);
+
+    // All bodies come from the atlas, so they go out as one batch of quads
+    r.bodies.clear();
+    for (const BodySnapshot &body : frame.bodies)
+    {
+        Pose pose = blendPose(body.previous, body.current, alpha);
+
+        // For the correct Y coordinate of our drawable rect, we must substract from WINDOW_HEIGHT
+        // because SFML uses OpenGL coordinate system where X is right, Y is down
+        // while Box2D uses traditional X is right, Y is up.
+        // The sprite's origin is the body's center, because in SFML "position" refers to the
+        // upper left corner while in Box2D, "position" refers to the body's center.
+        // For the rect to be rotated in the correct direction, we have to multiply by -1
+        appendQuad(r.bodies, *body.sprite,
+                   sf::Vector2f(pose.x * PPM, WINDOW_HEIGHT - (pose.y * PPM)),
+                   sf::Vector2f(body.width / 2, body.height / 2),
+                   -1 * pose.angle * DEG_PER_RAD);
+    }
+    w.draw(r.bodies, sf::RenderStates(r.atlas));
+
+    drawHud(w, r.hud, frame.total);
+
+    // Level map, from the layer drawn when the level started. The window's back buffer isn't kept
+    // between frames, so the whole layer goes out every frame as a single quad
+    top.setCenter(sf::Vector2f(0.5f * WINDOW_WIDTH, 0.5f * WINDOW_HEIGHT));
+    w.setView(top);
+    bool layer_current = r.layer_level == &level && r.layer_terrain == frame.show_terrain;
+    if (layer_current || buildTopLayer(r, level, frame.show_terrain)) {
+        sf::Sprite layer(r.top_layer.getTexture());
+        layer.setPosition(top.getCenter() - 0.5f * top.getSize());
+        w.draw(layer);
+    }
+
+    // Top view
+    Pose sambar_pose = blendPose(frame.top_previous, frame.top_current, alpha);
+    sf::Sprite samsprite(*frame.sambar_sprite->texture, frame.sambar_sprite->rect);
+    samsprite.setPosition(sambar_pose.x, WINDOW_HEIGHT - sambar_pose.y);
+    samsprite.setOrigin(16, 16);
+    samsprite.setRotation(sambar_pose.angle);
+    w.draw(samsprite);
+    profileEnd(r.profiler, Zone::Render, zone_start);
+
+    // Waits out vsync, so this is where a frame's spare time shows
+    zone_start = profileStart(r.profiler);
+    w.display();
+    profileEnd(r.profiler, Zone::Display, zone_start);
+}
+
+
+void drawFrames(Renderer &r, TripleBuffer<FrameSnapshot> &snapshots, const std::atomic<bool> &drawing)
+{
+    r.window.setActive(true);
+    while (drawing) {
+        // Interpolate by the wall time since the step, so drawing runs one step behind the
+        // simulation at whatever rate the display allows
+        const FrameSnapshot &frame = snapshots.latest();
+        std::chrono::duration<float> since = std::chrono::steady_clock::now() - frame.stepped_at;
+        float alpha = std::min(since.count() / TIME_STEP, 1.f);
+        render(r, frame, alpha);
+        // Once the frame has caught up with the latest step it can't change, so sleep until
+        // the simulation publishes again
+        if (alpha == 1.f) snapshots.wait();
+    }
+    r.window.setActive(false);
+}
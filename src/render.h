@@ -0,0 +1,38 @@
+#ifndef SAMBAR_RENDER_H
+#define SAMBAR_RENDER_H
+
+#include "game.h"
+#include "hud.h"
+#include "snapshot.h"
+#include <atomic>
+
+// Everything the window keeps from one frame to the next. While a level runs, only the drawing
+// thread touches it, apart from show_terrain
+struct Renderer
+{
+    sf::RenderWindow &window;
+    sf::View side;
+    sf::View top;
+    // Atlas holding every side-view sprite
+    const sf::Texture *atlas;
+    Hud hud{};
+    // One quad per side-view body in sight, refilled every frame and drawn in one call
+    sf::VertexArray bodies{sf::Quads};
+    // The top view without the sambar, drawn once for layer_level and then copied every frame
+    sf::RenderTexture top_layer{};
+    const Level *layer_level = nullptr;
+    bool layer_terrain = false;
+    // Tint the baked trees and mud over the map, toggled with F3 and passed on in each snapshot
+    bool show_terrain = false;
+    // Where drawing and display are timed, if anywhere
+    Profiler *profiler = nullptr;
+};
+
+// Draw frame alpha of the way from the previous physics step to the latest one
+void render(Renderer &r, const FrameSnapshot &frame, float alpha);
+// Draw the latest snapshot every frame until drawing is cleared, idling while no new one comes.
+// Runs on its own thread, which holds the window's context meanwhile. Publish once more after
+// clearing drawing, to wake it
+void drawFrames(Renderer &r, TripleBuffer<FrameSnapshot> &snapshots, const std::atomic<bool> &drawing);
+
+#endif
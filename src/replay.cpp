@@ -0,0 +1,222 @@
+#include "replay.h"
+#include "stacks.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <ostream>
+
+// Runs share one session, so anything that changes how a session carries bodies from one level
+// to the next changes what a recording plays back to. 2: bodies are pooled across levels.
+// 3: runs can be retried. 4: runs can start from a cached stack. 5: levels are numbered past 255.
+// Only files of the current version are read
+#define REPLAY_VERSION 5
+
+// Change mask bits, END closes a run
+#define CHANGED_FORCE 1
+#define CHANGED_ANGULAR_IMPULSE 2
+#define CHANGED_ROTATION 4
+#define RETRIED 8
+#define END_OF_RUN 0x80
+
+void recordControls(ReplayRun &run, long step, const Controls &controls) {
+    Controls last = run.changes.empty() ? Controls{} : run.changes.back().controls;
+    std::uint8_t mask = 0;
+    if (controls.force != last.force) mask |= CHANGED_FORCE;
+    if (controls.angular_impulse != last.angular_impulse) mask |= CHANGED_ANGULAR_IMPULSE;
+    if (controls.rotation != last.rotation) mask |= CHANGED_ROTATION;
+    if (mask != 0) {
+        run.changes.push_back(ControlChange{step, mask, controls});
+    }
+}
+
+void recordRetry(ReplayRun &run, long step) {
+    // Controls carry on across a retry, so the change keeps the last ones
+    Controls last = run.changes.empty() ? Controls{} : run.changes.back().controls;
+    run.changes.push_back(ControlChange{step, RETRIED, last});
+}
+
+void finishRun(ReplayRun &run, long steps, Outcome outcome, Simulation &sim) {
+    run.steps = steps;
+    run.outcome = outcome;
+    run.final_hash = hashState(sim);
+}
+
+const Controls &replayControls(ReplayCursor &cursor, long step) {
+    cursor.retry = false;
+    while (cursor.next < cursor.run->changes.size() && cursor.run->changes[cursor.next].step <= step) {
+        const ControlChange &change = cursor.run->changes[cursor.next++];
+        cursor.controls = change.controls;
+        if (change.mask & RETRIED) cursor.retry = true;
+    }
+    return cursor.controls;
+}
+
+// FNV-1a over the raw bits, so any drift at all shows up
+static void hashFloat(std::uint32_t &hash, float value) {
+    unsigned char bytes[sizeof(float)];
+    std::memcpy(bytes, &value, sizeof(float));
+    for (unsigned char byte : bytes) {
+        hash = (hash ^ byte) * 16777619u;
+    }
+}
+
+std::uint32_t hashState(Simulation &sim) {
+    std::uint32_t hash = 2166136261u;
+    for (const auto &box : sim.boxes) {
+        const b2Vec2 &p = box.body->GetPosition();
+        const b2Vec2 &v = box.body->GetLinearVelocity();
+        hashFloat(hash, p.x);
+        hashFloat(hash, p.y);
+        hashFloat(hash, box.body->GetAngle());
+        hashFloat(hash, v.x);
+        hashFloat(hash, v.y);
+    }
+    hashFloat(hash, sim.sambar_top.x);
+    hashFloat(hash, sim.sambar_top.y);
+    hashFloat(hash, sim.sambar_top.rotation);
+    return hash;
+}
+
+bool validRun(const ReplayRun &run, std::size_t n_levels, const StackCache &stacks) {
+    if (run.level < 0 || static_cast<std::size_t>(run.level) >= n_levels || run.n_boxes < 0) return false;
+    if (run.stack < 0) return run.stack == -1;
+    // startLevel places one cached body per box
+    return static_cast<std::size_t>(run.stack) < stacks.stacks.size()
+           && stacks.stacks[run.stack].n_boxes == run.n_boxes;
+}
+
+// Everything is little endian, step deltas are LEB128 varints
+static void putByte(std::ostream &out, std::uint8_t value) {
+    out.put(static_cast<char>(value));
+}
+
+static void putVarint(std::ostream &out, unsigned long value) {
+    while (value >= 0x80) {
+        putByte(out, static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    putByte(out, static_cast<std::uint8_t>(value));
+}
+
+static void putU32(std::ostream &out, std::uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        putByte(out, static_cast<std::uint8_t>(value >> (8 * i)));
+    }
+}
+
+static void putFloat(std::ostream &out, float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    putU32(out, bits);
+}
+
+bool writeReplayHeader(std::ostream &out) {
+    out.write("SRPL", 4);
+    putByte(out, REPLAY_VERSION);
+    return static_cast<bool>(out);
+}
+
+void writeReplayRun(std::ostream &out, const ReplayRun &run) {
+    putU32(out, run.seed);
+    // There are as many levels as files up to the first missing number, so there may be hundreds
+    putVarint(out, run.level);
+    putByte(out, static_cast<std::uint8_t>(run.n_boxes));
+    putVarint(out, run.stack + 1);
+
+    long last_step = 0;
+    for (const auto &change : run.changes) {
+        putVarint(out, change.step - last_step);
+        putByte(out, change.mask);
+        if (change.mask & CHANGED_FORCE) putFloat(out, change.controls.force);
+        if (change.mask & CHANGED_ANGULAR_IMPULSE) putFloat(out, change.controls.angular_impulse);
+        if (change.mask & CHANGED_ROTATION) putFloat(out, change.controls.rotation);
+        last_step = change.step;
+    }
+    putVarint(out, run.steps - last_step);
+    putByte(out, END_OF_RUN);
+    putByte(out, static_cast<std::uint8_t>(run.outcome));
+    putU32(out, run.final_hash);
+    out.flush();
+}
+
+// Reads from a byte buffer, pos goes past the end on truncated input
+struct Reader
+{
+    const std::vector<char> &data;
+    std::size_t pos = 0;
+
+    bool ok() const { return pos <= data.size(); }
+
+    std::uint8_t byte() {
+        if (pos >= data.size()) {
+            pos = data.size() + 1;
+            return 0;
+        }
+        return static_cast<std::uint8_t>(data[pos++]);
+    }
+
+    unsigned long varint() {
+        unsigned long value = 0;
+        for (int shift = 0; shift < 64 && ok(); shift += 7) {
+            std::uint8_t b = byte();
+            value |= static_cast<unsigned long>(b & 0x7f) << shift;
+            if (!(b & 0x80)) break;
+        }
+        return value;
+    }
+
+    std::uint32_t u32() {
+        std::uint32_t value = 0;
+        for (int i = 0; i < 4; i++) {
+            value |= static_cast<std::uint32_t>(byte()) << (8 * i);
+        }
+        return value;
+    }
+
+    float real() {
+        std::uint32_t bits = u32();
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+};
+
+bool loadReplay(const std::string &path, std::vector<ReplayRun> &runs) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::vector<char> data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+
+    Reader r{data};
+    if (data.size() < 5 || std::memcmp(data.data(), "SRPL", 4) != 0) return false;
+    r.pos = 4;
+    if (r.byte() != REPLAY_VERSION) return false;
+
+    runs.clear();
+    while (r.pos < data.size()) {
+        ReplayRun run;
+        run.seed = r.u32();
+        run.level = static_cast<int>(r.varint());
+        run.n_boxes = r.byte();
+        run.stack = static_cast<int>(r.varint()) - 1;
+
+        Controls controls;
+        long step = 0;
+        while (r.ok()) {
+            step += r.varint();
+            std::uint8_t mask = r.byte();
+            if (mask & END_OF_RUN) {
+                run.steps = step;
+                run.outcome = static_cast<Outcome>(r.byte());
+                run.final_hash = r.u32();
+                break;
+            }
+            if (mask & CHANGED_FORCE) controls.force = r.real();
+            if (mask & CHANGED_ANGULAR_IMPULSE) controls.angular_impulse = r.real();
+            if (mask & CHANGED_ROTATION) controls.rotation = r.real();
+            run.changes.push_back(ControlChange{step, mask, controls});
+        }
+        if (!r.ok()) return false;
+        runs.push_back(run);
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef SAMBAR_REPLAY_H
+#define SAMBAR_REPLAY_H
+
+#include "game.h"
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+// Controls that took effect at a given step, mask bits say which fields changed
+struct ControlChange
+{
+    long step;
+    std::uint8_t mask;
+    Controls controls;
+};
+
+// Everything needed to play one runLevel call back exactly
+struct ReplayRun
+{
+    std::uint32_t seed;
+    int level;
+    int n_boxes;
+    // Index of the cached stack the run started from, -1 if it was dropped from seed
+    int stack = -1;
+    std::vector<ControlChange> changes{};
+    long steps = 0;
+    Outcome outcome = Outcome::Running;
+    // Hash of the final body transforms, to check playback matched the recording
+    std::uint32_t final_hash = 0;
+};
+
+// Tracks where playback is within a run
+struct ReplayCursor
+{
+    const ReplayRun *run = nullptr;
+    std::size_t next = 0;
+    Controls controls{};
+    // Set by replayControls if the level was retried at that step
+    bool retry = false;
+};
+
+// Append a change if the controls for this step differ from the last recorded ones
+void recordControls(ReplayRun &run, long step, const Controls &controls);
+// Note that the level was retried just before this step
+void recordRetry(ReplayRun &run, long step);
+void finishRun(ReplayRun &run, long steps, Outcome outcome, Simulation &sim);
+// Controls in effect at this step, steps must be asked for in order
+const Controls &replayControls(ReplayCursor &cursor, long step);
+
+std::uint32_t hashState(Simulation &sim);
+// true if the run's level is among n_levels and its stack, if any, is in stacks with exactly the
+// run's box count, so it can be played back
+bool validRun(const ReplayRun &run, std::size_t n_levels, const StackCache &stacks);
+
+// Replay files: a header followed by any number of runs, runs are appended as they finish
+bool writeReplayHeader(std::ostream &out);
+void writeReplayRun(std::ostream &out, const ReplayRun &run);
+bool loadReplay(const std::string &path, std::vector<ReplayRun> &runs);
+
+#endif
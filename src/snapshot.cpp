@@ -0,0 +1,44 @@
+#include "snapshot.h"
+#include <algorithm>
+
+// Collects every body with a fixture in the queried box
+class VisibleBodies : public b2QueryCallback
+{
+public:
+    VisibleBodies(Simulation &sim, std::vector<BodySnapshot> &bodies) : sim(sim), bodies(bodies) {}
+
+    bool ReportFixture(b2Fixture *fixture) override {
+        // Every body has a single fixture, so none is reported twice
+        std::size_t i = fixture->GetBody()->GetUserData().pointer;
+        const Box &box = sim.boxes[i];
+        bodies.push_back(BodySnapshot{i, box.sprite, box.width, box.height, sim.previous[i], bodyPose(box.body)});
+        return true;
+    }
+
+private:
+    Simulation &sim;
+    std::vector<BodySnapshot> &bodies;
+};
+
+void takeSnapshot(FrameSnapshot &frame, Simulation &sim, float view_half_width) {
+    frame.level = sim.level;
+    frame.total = sim.total;
+    frame.truck_previous = sim.previous.back();
+    frame.truck_current = bodyPose(sim.boxes.back().body);
+    frame.sambar_sprite = sim.sambar_top.sprite;
+    frame.top_previous = sim.previous_top;
+    frame.top_current = Pose{sim.sambar_top.x, sim.sambar_top.y, sim.sambar_top.rotation};
+    frame.stepped_at = std::chrono::steady_clock::now();
+
+    // Only bodies the broad-phase finds near the side view get drawn
+    float centre = frame.truck_current.x * PPM;
+    b2AABB view;
+    view.lowerBound.Set((centre - view_half_width - CULL_MARGIN) / PPM, -CULL_MARGIN / PPM);
+    view.upperBound.Set((centre + view_half_width + CULL_MARGIN) / PPM, (WINDOW_HEIGHT + CULL_MARGIN) / PPM);
+    frame.bodies.clear();
+    VisibleBodies query(sim, frame.bodies);
+    sim.world.QueryAABB(&query, view);
+    // Keep the order of boxes, so the truck is still drawn over its load
+    std::sort(frame.bodies.begin(), frame.bodies.end(),
+              [](const BodySnapshot &a, const BodySnapshot &b) { return a.index < b.index; });
+}
@@ -0,0 +1,84 @@
+#ifndef SAMBAR_SNAPSHOT_H
+#define SAMBAR_SNAPSHOT_H
+
+#include "game.h"
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+// Furthest a sprite reaches past its body, in pixels
+#define CULL_MARGIN 128.f
+
+// A side-view body as drawn, between the last two steps
+struct BodySnapshot
+{
+    // Place in Simulation::boxes, which is also the order bodies are drawn in
+    std::size_t index;
+    const TextureRegion *sprite;
+    float width;
+    float height;
+    Pose previous;
+    Pose current;
+};
+
+// Everything a frame draws, copied out of the simulation after it steps, so drawing never
+// touches the physics world
+struct FrameSnapshot
+{
+    const Level *level = nullptr;
+    int total = 0;
+    bool show_terrain = false;
+    Pose truck_previous{};
+    Pose truck_current{};
+    // Only the bodies near the side view
+    std::vector<BodySnapshot> bodies;
+    const TextureRegion *sambar_sprite = nullptr;
+    Pose top_previous{};
+    Pose top_current{};
+    // When the latest step was taken, to interpolate from
+    std::chrono::steady_clock::time_point stepped_at;
+};
+
+// Copy sim into frame, keeping the bodies within view_half_width pixels of the truck plus CULL_MARGIN
+void takeSnapshot(FrameSnapshot &frame, Simulation &sim, float view_half_width);
+
+// Passes the latest value from one writer thread to one reader thread without locking. Each side
+// owns one buffer and the third is swapped through an atomic, so neither ever waits on the other
+// and the reader always gets the newest complete value
+template <typename T>
+class TripleBuffer
+{
+public:
+    // The writer's buffer, to fill before publish()
+    T &back() { return buffers[write]; }
+    void publish() {
+        write = middle.exchange(write | FRESH, std::memory_order_acq_rel) & INDEX;
+        middle.notify_one();
+    }
+    // The newest published value. It stays valid until the next call
+    const T &latest() {
+        if (middle.load(std::memory_order_relaxed) & FRESH) {
+            read = middle.exchange(read, std::memory_order_acq_rel) & INDEX;
+        }
+        return buffers[read];
+    }
+    // Block the reader until something newer than latest() has been published
+    void wait() {
+        unsigned m = middle.load(std::memory_order_acquire);
+        while (!(m & FRESH)) {
+            middle.wait(m, std::memory_order_acquire);
+            m = middle.load(std::memory_order_acquire);
+        }
+    }
+
+private:
+    static const unsigned INDEX = 3;
+    static const unsigned FRESH = 4;
+
+    T buffers[3];
+    unsigned write = 0;
+    unsigned read = 1;
+    std::atomic<unsigned> middle{2};
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include "stacks.h"
+#include "game.h"
+#include "headless.h"
+#include "mapped_file.h"
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#define STACK_VERSION 1
+// Longest a stack may take to fall asleep before its seed is passed over, 30 s
+#define SETTLE_MAX_STEPS (30 * 60)
+// Seeds tried per box count before settling for fewer stacks
+#define SETTLE_MAX_SEEDS 4096
+
+static_assert(std::endian::native == std::endian::little, "stack files are read in place as little endian");
+static_assert(sizeof(SettledBody) == 4 * sizeof(float), "settled bodies are copied straight from stack files");
+static_assert(sizeof(ContactState) == 9 * sizeof(float), "contacts are copied straight from stack files");
+
+struct StackHeader
+{
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t stack_count;
+    std::uint32_t body_count;
+    std::uint32_t contact_count;
+};
+
+static bool parseStacks(const unsigned char *bytes, std::size_t size, StackCache &cache) {
+    if (size < sizeof(StackHeader)) return false;
+
+    StackHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, "SSTK", 4) != 0 || header.version != STACK_VERSION) return false;
+    std::size_t counts_size = std::size_t(header.stack_count) * 2 * sizeof(std::uint32_t);
+    std::size_t bodies_size = std::size_t(header.body_count) * sizeof(SettledBody);
+    if (size != sizeof(header) + counts_size + bodies_size + std::size_t(header.contact_count) * sizeof(ContactState)) {
+        return false;
+    }
+
+    const unsigned char *data = bytes + sizeof(header);
+    const std::uint32_t *counts = reinterpret_cast<const std::uint32_t *>(data);
+    const SettledBody *bodies = reinterpret_cast<const SettledBody *>(data + counts_size);
+    const SettledBody *bodies_end = bodies + header.body_count;
+    const ContactState *contacts = reinterpret_cast<const ContactState *>(data + counts_size + bodies_size);
+    const ContactState *contacts_end = contacts + header.contact_count;
+    cache.stacks.resize(header.stack_count);
+    for (std::uint32_t i = 0; i < header.stack_count; i++) {
+        // Crates and the truck
+        std::size_t n = std::size_t(counts[2 * i]) + 1;
+        std::size_t m = counts[2 * i + 1];
+        if (static_cast<std::size_t>(bodies_end - bodies) < n || static_cast<std::size_t>(contacts_end - contacts) < m) {
+            return false;
+        }
+        cache.stacks[i].n_boxes = counts[2 * i];
+        cache.stacks[i].bodies.assign(bodies, bodies + n);
+        cache.stacks[i].contacts.assign(contacts, contacts + m);
+        bodies += n;
+        contacts += m;
+    }
+    return bodies == bodies_end && contacts == contacts_end;
+}
+
+bool loadStacks(const std::string &path, StackCache &cache, const AssetArchive *archive) {
+    cache.stacks.clear();
+    std::size_t size;
+    const unsigned char *packed = archive ? archive->find(path, size) : nullptr;
+    MappedFile file;
+    if (!packed) {
+        if (!file.open(path)) return !std::ifstream(path);
+        packed = file.data();
+        size = file.size();
+    }
+    if (!parseStacks(packed, size, cache)) {
+        cache.stacks.clear();
+        return false;
+    }
+    return true;
+}
+
+bool saveStacks(const std::string &path, const StackCache &cache) {
+    StackHeader header{};
+    std::memcpy(header.magic, "SSTK", 4);
+    header.version = STACK_VERSION;
+    header.stack_count = cache.stacks.size();
+    for (const auto &stack : cache.stacks) {
+        header.body_count += stack.bodies.size();
+        header.contact_count += stack.contacts.size();
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const auto &stack : cache.stacks) {
+        std::uint32_t counts[2] {static_cast<std::uint32_t>(stack.n_boxes), static_cast<std::uint32_t>(stack.contacts.size())};
+        out.write(reinterpret_cast<const char *>(counts), sizeof(counts));
+    }
+    for (const auto &stack : cache.stacks) {
+        out.write(reinterpret_cast<const char *>(stack.bodies.data()), stack.bodies.size() * sizeof(SettledBody));
+    }
+    for (const auto &stack : cache.stacks) {
+        out.write(reinterpret_cast<const char *>(stack.contacts.data()), stack.contacts.size() * sizeof(ContactState));
+    }
+    return static_cast<bool>(out);
+}
+
+int pickStack(const StackCache &cache, int n_boxes, std::uint32_t seed) {
+    int first = -1;
+    int count = 0;
+    for (std::size_t i = 0; i < cache.stacks.size(); i++) {
+        if (cache.stacks[i].n_boxes != n_boxes) continue;
+        if (first < 0) first = i;
+        count++;
+    }
+    return count ? first + seed % count : -1;
+}
+
+// Drop the stack seed makes onto a truck left standing, and keep it if every crate falls asleep
+// on it. Stacks of a box count are stored together, so pickStack finds them in a run
+static bool settleStack(int n_boxes, std::uint32_t seed, SettledStack &stack) {
+    // Stand-in sprites, only to tell which kind each crate drew
+    TextureRegion kinds[STACK_SPRITES];
+    Artwork art;
+    art.crate1 = &kinds[0];
+    art.crate2 = &kinds[1];
+    art.basket1 = &kinds[2];
+    art.basket2 = &kinds[3];
+    Level level;
+    Simulation sim;
+    startLevel(sim, level, n_boxes, seed, art);
+
+    // The world alone, with no driving, so nothing keeps the truck awake
+    for (long step = 0; step < SETTLE_MAX_STEPS && !sim.ground.struck; step++) {
+        sim.world.Step(TIME_STEP, 6, 3);
+        bool asleep = true;
+        for (int i = 1; i <= n_boxes && asleep; i++) {
+            asleep = !sim.boxes[i].body->IsAwake();
+        }
+        if (!asleep) continue;
+
+        stack.n_boxes = n_boxes;
+        stack.bodies.clear();
+        for (std::size_t i = 1; i < sim.boxes.size(); i++) {
+            std::uint32_t kind = 0;
+            while (kind < STACK_SPRITES && stackSprite(art, kind) != sim.boxes[i].sprite) kind++;
+            const b2Vec2 &p = sim.boxes[i].body->GetPosition();
+            stack.bodies.push_back(SettledBody{kind, p.x, p.y, sim.boxes[i].body->GetAngle()});
+        }
+        WorldSnapshot snapshot;
+        captureWorld(snapshot, sim);
+        stack.contacts = snapshot.contacts;
+        return true;
+    }
+    return false;
+}
+
+int runSettleStacks(int argc, char *argv[]) {
+    std::uint32_t seed = 0;
+    bool valid = argc == 3 || (argc == 5 && std::string(argv[3]) == "--first-seed" && parseValue(argv[4], seed));
+    if (!valid) {
+        std::cerr << "usage: sambar --settle-stacks <stack file> [--first-seed n]" << std::endl;
+        return -1;
+    }
+
+    StackCache cache;
+    for (int n_boxes = STACK_MIN_BOXES; n_boxes <= STACK_MAX_BOXES; n_boxes++) {
+        int kept = 0;
+        int tried = 0;
+        for (; kept < STACKS_PER_COUNT && tried < SETTLE_MAX_SEEDS; tried++) {
+            SettledStack stack;
+            if (settleStack(n_boxes, seed++, stack)) {
+                cache.stacks.push_back(stack);
+                kept++;
+            }
+        }
+        std::cout << n_boxes << " boxes: " << kept << " stacks from " << tried << " seeds" << std::endl;
+    }
+
+    if (!saveStacks(argv[2], cache)) {
+        std::cerr << "cannot write stacks " << argv[2] << std::endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef SAMBAR_STACKS_H
+#define SAMBAR_STACKS_H
+
+#include "archive.h"
+#include "game.h"
+#include "world_snapshot.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Where the game looks for its pre-settled stacks, relative to the working directory
+#define STACK_FILE "levels/stacks.stk"
+// Stacks the generator keeps for each box count, and the box counts it covers
+#define STACKS_PER_COUNT 16
+#define STACK_MIN_BOXES MIN_BOXES
+#define STACK_MAX_BOXES MAX_BOXES
+
+// A crate, basket or the truck at rest, in Box2D units. sprite is the crate's stackSprite kind
+struct SettledBody
+{
+    std::uint32_t sprite;
+    float x;
+    float y;
+    float angle;
+};
+
+// A stack that has come to rest on the standing truck: n_boxes crates, then the truck, and the
+// contacts holding them up, to warm-start the solver with
+struct SettledStack
+{
+    int n_boxes;
+    std::vector<SettledBody> bodies;
+    std::vector<ContactState> contacts;
+};
+
+struct StackCache
+{
+    std::vector<SettledStack> stacks;
+};
+
+// Stack files are little endian and 4-byte aligned:
+//   "SSTK", u32 version, u32 stack count, u32 body count, u32 contact count,
+//   then u32 box count and u32 contact count per stack,
+//   then u32 sprite, f32 x, y, angle for every body of every stack,
+//   then every contact of every stack as a ContactState
+// An empty cache and true if there is no file, false if there is one that can't be read
+bool loadStacks(const std::string &path, StackCache &cache, const AssetArchive *archive = nullptr);
+bool saveStacks(const std::string &path, const StackCache &cache);
+// Index of the cached stack for this box count that seed picks, -1 if there are none
+int pickStack(const StackCache &cache, int n_boxes, std::uint32_t seed);
+
+// sambar --settle-stacks <stack file> [--first-seed n]: drop stacks on a standing truck until they
+// sleep, keeping STACKS_PER_COUNT of each box count that land without touching the ground
+int runSettleStacks(int argc, char *argv[]);
+
+#endif
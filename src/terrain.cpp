@@ -0,0 +1,135 @@
+#include "terrain.h"
+#include <algorithm>
+#include <cmath>
+
+Terrain terrainAt(const TerrainMask &mask, float x, float y) {
+    int c = static_cast<int>(std::floor((x - mask.left) / mask.texel_size));
+    int r = static_cast<int>(std::floor((mask.top - y) / mask.texel_size));
+    if (c < 0 || r < 0 || c >= mask.columns || r >= mask.rows) {
+        return Terrain::Clear;
+    }
+    return mask.texels[r * mask.columns + c];
+}
+
+static bool texelIs(const TerrainMask &mask, int c, int r, Terrain terrain) {
+    if (c < 0 || r < 0 || c >= mask.columns || r >= mask.rows) return terrain == Terrain::Clear;
+    return mask.texels[r * mask.columns + c] == terrain;
+}
+
+bool sweepTerrain(const TerrainMask &mask, Terrain terrain, float x0, float y0, float x1, float y1, float &toi) {
+    toi = 0;
+    if (terrainAt(mask, x0, y0) == terrain) return true;
+
+    // Walk every texel the path crosses, in order, in texel units with rows counting down
+    float u0 = (x0 - mask.left) / mask.texel_size;
+    float v0 = (mask.top - y0) / mask.texel_size;
+    float du = (x1 - x0) / mask.texel_size;
+    float dv = (y0 - y1) / mask.texel_size;
+    int c = static_cast<int>(std::floor(u0));
+    int r = static_cast<int>(std::floor(v0));
+    int step_c = du > 0 ? 1 : -1;
+    int step_r = dv > 0 ? 1 : -1;
+    // Fraction of the move to the next column and row boundary, and between boundaries
+    float next_c = du > 0 ? (c + 1 - u0) / du : du < 0 ? (u0 - c) / -du : INFINITY;
+    float next_r = dv > 0 ? (r + 1 - v0) / dv : dv < 0 ? (v0 - r) / -dv : INFINITY;
+    float delta_c = du != 0 ? 1 / std::abs(du) : INFINITY;
+    float delta_r = dv != 0 ? 1 / std::abs(dv) : INFINITY;
+    // Boundaries closer than this, a ten-thousandth of a texel, count as one corner, so rounding
+    // can't decide which side of a corner the path goes
+    float length = std::sqrt(du * du + dv * dv);
+    float corner = 1e-4f / length;
+
+    for (;;) {
+        float t = std::min(next_c, next_r);
+        if (t > 1) break;
+        bool hit;
+        if (next_c < next_r - corner) {
+            c += step_c;
+            next_c += delta_c;
+            hit = texelIs(mask, c, r, terrain);
+        } else if (next_r < next_c - corner) {
+            r += step_r;
+            next_r += delta_r;
+            hit = texelIs(mask, c, r, terrain);
+        } else {
+            // Through a corner: the texels on either side of it are touched too
+            hit = texelIs(mask, c + step_c, r, terrain) || texelIs(mask, c, r + step_r, terrain);
+            c += step_c;
+            r += step_r;
+            next_c += delta_c;
+            next_r += delta_r;
+            hit = hit || texelIs(mask, c, r, terrain);
+        }
+        if (hit) {
+            // Stop a hundredth of a texel short, so the stopping point is still outside
+            toi = std::max(0.f, t - 0.01f / length);
+            return true;
+        }
+    }
+    toi = 1;
+    return false;
+}
+
+static bool inPalette(const std::vector<std::uint32_t> &colours, std::uint32_t colour) {
+    return std::find(colours.begin(), colours.end(), colour) != colours.end();
+}
+
+void bakeTerrain(TerrainMask &mask, const std::uint8_t *rgba, int width, int height,
+                 const TerrainPalette &palette, float left, float top, float scale) {
+    mask = TerrainMask{};
+    mask.left = left;
+    mask.top = top;
+    mask.texel_size = scale * TERRAIN_TEXEL_PIXELS;
+    mask.columns = width / TERRAIN_TEXEL_PIXELS;
+    mask.rows = height / TERRAIN_TEXEL_PIXELS;
+    mask.texels.assign(mask.columns * mask.rows, Terrain::Clear);
+
+    // Classify each pixel by its colour, transparent pixels are never anything
+    std::vector<Terrain> pixels(width * height, Terrain::Clear);
+    for (int i = 0; i < width * height; i++) {
+        const std::uint8_t *p = rgba + 4 * i;
+        if (p[3] < 128) continue;
+        std::uint32_t colour = p[0] << 16 | p[1] << 8 | p[2];
+        if (inPalette(palette.tree, colour)) {
+            pixels[i] = Terrain::Tree;
+        } else if (inPalette(palette.mud, colour)) {
+            pixels[i] = Terrain::Mud;
+        }
+    }
+
+    // Vote over the texel's own pixels and a texel's width of neighbours on every side
+    for (int r = 0; r < mask.rows; r++) {
+        for (int c = 0; c < mask.columns; c++) {
+            int x0 = std::max(0, (c - 1) * TERRAIN_TEXEL_PIXELS);
+            int x1 = std::min(width, (c + 2) * TERRAIN_TEXEL_PIXELS);
+            int y0 = std::max(0, (r - 1) * TERRAIN_TEXEL_PIXELS);
+            int y1 = std::min(height, (r + 2) * TERRAIN_TEXEL_PIXELS);
+            int trees = 0, mud = 0;
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    trees += pixels[y * width + x] == Terrain::Tree;
+                    mud += pixels[y * width + x] == Terrain::Mud;
+                }
+            }
+            int votes = (x1 - x0) * (y1 - y0);
+            Terrain &texel = mask.texels[r * mask.columns + c];
+            if (2 * trees > votes) {
+                texel = Terrain::Tree;
+            } else if (2 * mud > votes) {
+                texel = Terrain::Mud;
+            }
+        }
+    }
+}
+
+void stampTerrain(TerrainMask &mask, const Obstacle &circle, Terrain terrain) {
+    for (int r = 0; r < mask.rows; r++) {
+        for (int c = 0; c < mask.columns; c++) {
+            float dx = mask.left + (c + 0.5f) * mask.texel_size - circle.x;
+            float dy = mask.top - (r + 0.5f) * mask.texel_size - circle.y;
+            if (dx * dx + dy * dy < circle.radius * circle.radius) {
+                mask.texels[r * mask.columns + c] = terrain;
+            }
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef SAMBAR_TERRAIN_H
+#define SAMBAR_TERRAIN_H
+
+#include "obstacles.h"
+#include <cstdint>
+#include <vector>
+
+// Level image pixels along each side of a terrain texel
+#define TERRAIN_TEXEL_PIXELS 2
+
+enum class Terrain : std::uint8_t
+{
+    Clear,
+    Tree,
+    Mud
+};
+
+// Low-resolution map of what covers the ground, in top-down coordinates with y up.
+// Texel (c, r) starts at x = left + c * texel_size and reaches down from y = top - r * texel_size
+struct TerrainMask
+{
+    float left = 0.f;
+    float top = 0.f;
+    float texel_size = 1.f;
+    int columns = 0;
+    int rows = 0;
+    std::vector<Terrain> texels;
+};
+
+// Colours, as 0xRRGGBB, that the level art uses for trees and for mud
+struct TerrainPalette
+{
+    std::vector<std::uint32_t> tree;
+    std::vector<std::uint32_t> mud;
+};
+
+// What covers (x, y), Clear off the edge of the mask
+Terrain terrainAt(const TerrainMask &mask, float x, float y);
+// Sweep a point from (x0, y0) to (x1, y1) through every texel it crosses, corners included. If it
+// runs into terrain on the way, return true and set toi to the fraction of the move it can make
+// before that, 0 if it starts there
+bool sweepTerrain(const TerrainMask &mask, Terrain terrain, float x0, float y0, float x1, float y1, float &toi);
+
+// Segment an RGBA level image drawn scale times its size with its top left corner at (left, top).
+// Each texel takes whichever of tree and mud covers most of the pixels around it, so lone
+// specks of a matching colour are ignored
+void bakeTerrain(TerrainMask &mask, const std::uint8_t *rgba, int width, int height,
+                 const TerrainPalette &palette, float left, float top, float scale);
+// Set every texel whose centre lies inside the circle
+void stampTerrain(TerrainMask &mask, const Obstacle &circle, Terrain terrain);
+
+#endif
@@ -0,0 +1,110 @@
+#include "textures.h"
+#include "assets.h"
+#include <algorithm>
+
+// Free space left around every atlas entry so smoothing never bleeds between them
+#define ATLAS_PADDING 1
+#define ATLAS_MIN_WIDTH 256
+
+sf::IntRect clipArea(const sf::IntRect &area, const sf::Vector2u &size) {
+    // Same clipping as sf::Texture::loadFromImage
+    sf::IntRect clipped = area;
+    if (clipped.width == 0 || clipped.height == 0) {
+        clipped = sf::IntRect(0, 0, size.x, size.y);
+    }
+    clipped.left = std::max(clipped.left, 0);
+    clipped.top = std::max(clipped.top, 0);
+    clipped.width = std::min<int>(clipped.width, size.x - clipped.left);
+    clipped.height = std::min<int>(clipped.height, size.y - clipped.top);
+    return clipped;
+}
+
+const sf::Texture *TextureRegistry::load(const std::string &path, const sf::IntRect &area) {
+    Key key{path, area.left, area.top, area.width, area.height};
+    auto found = textures.find(key);
+    if (found != textures.end()) {
+        return found->second.get();
+    }
+
+    auto texture = std::make_unique<sf::Texture>();
+    if (!(cache ? cache->loadTexture(path, area, *texture) : texture->loadFromFile(path, area))) {
+        return nullptr;
+    }
+    return textures.emplace(key, std::move(texture)).first->second.get();
+}
+
+const sf::Texture *TextureRegistry::add(const std::string &path, const sf::Image &image, const sf::IntRect &area) {
+    Key key{path, area.left, area.top, area.width, area.height};
+    auto found = textures.find(key);
+    if (found != textures.end()) {
+        return found->second.get();
+    }
+
+    auto texture = std::make_unique<sf::Texture>();
+    if (!texture->loadFromImage(image, area)) {
+        return nullptr;
+    }
+    return textures.emplace(key, std::move(texture)).first->second.get();
+}
+
+const TextureRegion *TextureAtlas::add(const std::string &path, const sf::Image &image, const sf::IntRect &area) {
+    Key key{path, area.left, area.top, area.width, area.height};
+    auto found = regions.find(key);
+    if (found != regions.end()) {
+        return &found->second;
+    }
+
+    sf::IntRect clipped = clipArea(area, image.getSize());
+    if (clipped.width <= 0 || clipped.height <= 0) {
+        return nullptr;
+    }
+
+    TextureRegion *region = &regions[key];
+    pending.push_back(Pending{image, clipped, region});
+    return region;
+}
+
+bool TextureAtlas::build() {
+    if (pending.empty()) {
+        return true;
+    }
+
+    // Shelf packing, tallest first
+    std::sort(pending.begin(), pending.end(),
+              [](const Pending &a, const Pending &b) { return a.area.height > b.area.height; });
+    int width = ATLAS_MIN_WIDTH;
+    for (const auto &p : pending) {
+        width = std::max(width, p.area.width + 2 * ATLAS_PADDING);
+    }
+
+    int x = 0, y = 0, shelf_height = 0;
+    std::vector<sf::Vector2i> positions;
+    for (const auto &p : pending) {
+        if (x + p.area.width + 2 * ATLAS_PADDING > width) {
+            x = 0;
+            y += shelf_height;
+            shelf_height = 0;
+        }
+        positions.push_back(sf::Vector2i(x + ATLAS_PADDING, y + ATLAS_PADDING));
+        x += p.area.width + 2 * ATLAS_PADDING;
+        shelf_height = std::max(shelf_height, p.area.height + 2 * ATLAS_PADDING);
+    }
+    int height = y + shelf_height;
+
+    sf::Image atlas;
+    atlas.create(width, height, sf::Color::Transparent);
+    for (std::size_t i = 0; i < pending.size(); i++) {
+        atlas.copy(pending[i].image, positions[i].x, positions[i].y, pending[i].area);
+    }
+    if (!texture.loadFromImage(atlas)) {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < pending.size(); i++) {
+        pending[i].region->texture = &texture;
+        pending[i].region->rect = sf::IntRect(positions[i].x, positions[i].y,
+                                              pending[i].area.width, pending[i].area.height);
+    }
+    pending.clear();
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef SAMBAR_TEXTURES_H
+#define SAMBAR_TEXTURES_H
+
+#include "assets.h"
+#include <SFML/Graphics.hpp>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Part of a texture, as drawn by one sprite
+struct TextureRegion
+{
+    const sf::Texture *texture = nullptr;
+    sf::IntRect rect;
+};
+
+// The part of an image of this size that sf::Texture would load for area, empty if none
+sf::IntRect clipArea(const sf::IntRect &area, const sf::Vector2u &size);
+
+// Loads every image once and hands out pointers to the shared texture.
+// Pointers stay valid for the life of the registry
+class TextureRegistry
+{
+public:
+    // Images come through the cache when given one, else straight from disk
+    explicit TextureRegistry(const ImageCache *cache = nullptr) : cache(cache) {}
+
+    // The texture for this file and area, loading it the first time. nullptr if it can't be loaded
+    const sf::Texture *load(const std::string &path, const sf::IntRect &area = sf::IntRect());
+    // The same, from an image already decoded from path
+    const sf::Texture *add(const std::string &path, const sf::Image &image, const sf::IntRect &area = sf::IntRect());
+
+private:
+    typedef std::tuple<std::string, int, int, int, int> Key;
+    const ImageCache *cache;
+    std::map<Key, std::unique_ptr<sf::Texture>> textures;
+};
+
+// Packs small images into one texture, so everything drawn from it can go out in a single draw call
+class TextureAtlas
+{
+public:
+    // Add an image decoded from path, or an area of it clipped to the image the way sf::Texture does.
+    // The region is filled in by build(), nullptr if the area is empty
+    const TextureRegion *add(const std::string &path, const sf::Image &image, const sf::IntRect &area = sf::IntRect());
+    // Pack everything added and upload the atlas texture, once all images are in
+    bool build();
+    const sf::Texture &getTexture() const { return texture; }
+
+private:
+    typedef std::tuple<std::string, int, int, int, int> Key;
+    struct Pending
+    {
+        sf::Image image;
+        sf::IntRect area;
+        TextureRegion *region;
+    };
+
+    sf::Texture texture;
+    std::map<Key, TextureRegion> regions;
+    std::vector<Pending> pending;
+};
+
+#endif
@@ -0,0 +1,258 @@
+#include "world_file.h"
+#include "mapped_file.h"
+#include <bit>
+#include <cstring>
+#include <fstream>
+
+#define WORLD_VERSION 2
+
+// Body flags
+#define BODY_AWAKE 1
+#define BODY_ENABLED 2
+#define BODY_BULLET 4
+#define BODY_FIXED_ROTATION 8
+#define BODY_SLEEPING_ALLOWED 16
+#define BODY_SENSOR 32
+
+static_assert(std::endian::native == std::endian::little, "world files are read in place as little endian");
+
+struct WorldHeader
+{
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t level;
+    std::uint32_t n_boxes;
+    std::int32_t total;
+    std::uint32_t body_count;
+    std::uint32_t vertex_count;
+    std::uint32_t contact_count;
+    float gravity[2];
+    float top[3];
+    std::uint32_t struck;
+};
+
+struct WorldBody
+{
+    std::uint32_t type;
+    std::uint32_t sprite;
+    std::uint32_t flags;
+    float width;
+    float height;
+    float position[2];
+    float angle;
+    float linear_velocity[2];
+    float angular_velocity;
+    float linear_damping;
+    float angular_damping;
+    float gravity_scale;
+    std::uint32_t fixture_kind;
+    std::uint32_t vertex_count;
+    float density;
+    float friction;
+    float restitution;
+    float restitution_threshold;
+    float radius;
+    float centroid[2];
+};
+
+struct WorldVertex
+{
+    float x;
+    float y;
+    float normal_x;
+    float normal_y;
+};
+
+// Sprites a body can link back to, by their place here
+static const TextureRegion *Artwork::*const body_sprites[] {
+    &Artwork::crate1, &Artwork::crate2, &Artwork::basket1, &Artwork::basket2, &Artwork::sambar_side};
+
+static std::uint32_t spriteIndex(const Artwork &art, const TextureRegion *sprite) {
+    std::uint32_t i = 0;
+    while (i + 1 < std::size(body_sprites) && art.*body_sprites[i] != sprite) i++;
+    return i;
+}
+
+bool saveWorld(const std::string &path, const Simulation &sim, const Artwork &art, int level) {
+    WorldHeader header{};
+    std::memcpy(header.magic, "SWLD", 4);
+    header.version = WORLD_VERSION;
+    header.level = level;
+    header.n_boxes = sim.n_boxes;
+    header.total = sim.total;
+    header.body_count = sim.boxes.size();
+    b2Vec2 gravity = sim.world.GetGravity();
+    header.gravity[0] = gravity.x;
+    header.gravity[1] = gravity.y;
+    header.top[0] = sim.sambar_top.x;
+    header.top[1] = sim.sambar_top.y;
+    header.top[2] = sim.sambar_top.rotation;
+    header.struck = sim.ground.struck;
+
+    std::vector<WorldBody> bodies;
+    std::vector<WorldVertex> vertices;
+    for (const auto &box : sim.boxes) {
+        const b2Body *body = box.body;
+        const b2Fixture *fixture = body->GetFixtureList();
+        if (!fixture || fixture->GetNext() || fixture->GetType() != b2Shape::e_polygon) return false;
+        const b2PolygonShape *shape = static_cast<const b2PolygonShape *>(fixture->GetShape());
+
+        WorldBody saved{};
+        saved.type = body->GetType();
+        saved.sprite = spriteIndex(art, box.sprite);
+        saved.flags = (body->IsAwake() ? BODY_AWAKE : 0) | (body->IsEnabled() ? BODY_ENABLED : 0)
+                    | (body->IsBullet() ? BODY_BULLET : 0) | (body->IsFixedRotation() ? BODY_FIXED_ROTATION : 0)
+                    | (body->IsSleepingAllowed() ? BODY_SLEEPING_ALLOWED : 0) | (fixture->IsSensor() ? BODY_SENSOR : 0);
+        saved.width = box.width;
+        saved.height = box.height;
+        saved.position[0] = body->GetPosition().x;
+        saved.position[1] = body->GetPosition().y;
+        saved.angle = body->GetAngle();
+        saved.linear_velocity[0] = body->GetLinearVelocity().x;
+        saved.linear_velocity[1] = body->GetLinearVelocity().y;
+        saved.angular_velocity = body->GetAngularVelocity();
+        saved.linear_damping = body->GetLinearDamping();
+        saved.angular_damping = body->GetAngularDamping();
+        saved.gravity_scale = body->GetGravityScale();
+        saved.fixture_kind = fixture->GetUserData().pointer;
+        saved.vertex_count = shape->m_count;
+        saved.density = fixture->GetDensity();
+        saved.friction = fixture->GetFriction();
+        saved.restitution = fixture->GetRestitution();
+        saved.restitution_threshold = fixture->GetRestitutionThreshold();
+        saved.radius = shape->m_radius;
+        saved.centroid[0] = shape->m_centroid.x;
+        saved.centroid[1] = shape->m_centroid.y;
+        bodies.push_back(saved);
+        for (int i = 0; i < shape->m_count; i++) {
+            vertices.push_back(WorldVertex{shape->m_vertices[i].x, shape->m_vertices[i].y,
+                                           shape->m_normals[i].x, shape->m_normals[i].y});
+        }
+    }
+    WorldSnapshot snapshot;
+    captureWorld(snapshot, sim);
+    header.vertex_count = vertices.size();
+    header.contact_count = snapshot.contacts.size();
+
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(bodies.data()), bodies.size() * sizeof(WorldBody));
+    out.write(reinterpret_cast<const char *>(vertices.data()), vertices.size() * sizeof(WorldVertex));
+    out.write(reinterpret_cast<const char *>(snapshot.contacts.data()), snapshot.contacts.size() * sizeof(ContactState));
+    return static_cast<bool>(out);
+}
+
+// Build one saved body in the world, with its shape copied as it was rather than rebuilt, so the
+// vertices keep their order and contacts their feature ids
+static b2Body *createBody(b2World &world, const WorldBody &saved, const WorldVertex *vertices) {
+    b2BodyDef def;
+    def.type = static_cast<b2BodyType>(saved.type);
+    def.position.Set(saved.position[0], saved.position[1]);
+    def.angle = saved.angle;
+    def.linearVelocity.Set(saved.linear_velocity[0], saved.linear_velocity[1]);
+    def.angularVelocity = saved.angular_velocity;
+    def.linearDamping = saved.linear_damping;
+    def.angularDamping = saved.angular_damping;
+    def.gravityScale = saved.gravity_scale;
+    def.awake = saved.flags & BODY_AWAKE;
+    def.enabled = saved.flags & BODY_ENABLED;
+    def.bullet = saved.flags & BODY_BULLET;
+    def.fixedRotation = saved.flags & BODY_FIXED_ROTATION;
+    def.allowSleep = saved.flags & BODY_SLEEPING_ALLOWED;
+
+    b2PolygonShape shape;
+    shape.m_count = saved.vertex_count;
+    shape.m_radius = saved.radius;
+    shape.m_centroid.Set(saved.centroid[0], saved.centroid[1]);
+    for (std::uint32_t i = 0; i < saved.vertex_count; i++) {
+        shape.m_vertices[i].Set(vertices[i].x, vertices[i].y);
+        shape.m_normals[i].Set(vertices[i].normal_x, vertices[i].normal_y);
+    }
+
+    b2FixtureDef fixture;
+    fixture.shape = &shape;
+    fixture.density = saved.density;
+    fixture.friction = saved.friction;
+    fixture.restitution = saved.restitution;
+    fixture.restitutionThreshold = saved.restitution_threshold;
+    fixture.isSensor = saved.flags & BODY_SENSOR;
+    fixture.userData.pointer = saved.fixture_kind;
+
+    b2Body *body = world.CreateBody(&def);
+    body->CreateFixture(&fixture);
+    return body;
+}
+
+bool loadWorld(const std::string &path, Simulation &sim, std::vector<Level> &levels, Artwork &art, int &level) {
+    if (!sim.boxes.empty()) return false;
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(WorldHeader)) return false;
+
+    WorldHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, "SWLD", 4) != 0 || header.version != WORLD_VERSION) return false;
+    std::size_t bodies_size = std::size_t(header.body_count) * sizeof(WorldBody);
+    std::size_t vertices_size = std::size_t(header.vertex_count) * sizeof(WorldVertex);
+    std::size_t contacts_size = std::size_t(header.contact_count) * sizeof(ContactState);
+    if (file.size() != sizeof(header) + bodies_size + vertices_size + contacts_size) return false;
+    // Ground, the crates and the truck, and a level to drive them on. Bounding the crates first keeps
+    // n_boxes + 2 from wrapping, so there are always at least the ground and the truck
+    if (header.n_boxes > MAX_BOXES || header.body_count != header.n_boxes + 2 || header.level >= levels.size()) {
+        return false;
+    }
+
+    const unsigned char *data = file.data() + sizeof(header);
+    const WorldBody *bodies = reinterpret_cast<const WorldBody *>(data);
+    const WorldVertex *vertices = reinterpret_cast<const WorldVertex *>(data + bodies_size);
+    const ContactState *contacts = reinterpret_cast<const ContactState *>(data + bodies_size + vertices_size);
+    std::size_t next_vertex = 0;
+    for (std::uint32_t i = 0; i < header.body_count; i++) {
+        const WorldBody &saved = bodies[i];
+        if (saved.vertex_count < 3 || saved.vertex_count > b2_maxPolygonVertices
+            || saved.vertex_count > header.vertex_count - next_vertex) {
+            return false;
+        }
+        // Enums and indices only ever take values the game gives them
+        if (saved.type > b2_dynamicBody || saved.fixture_kind > static_cast<std::uint32_t>(FixtureKind::Truck)
+            || saved.sprite >= std::size(body_sprites)) {
+            return false;
+        }
+        next_vertex += saved.vertex_count;
+    }
+    if (next_vertex != header.vertex_count) return false;
+
+    // Every body joins the pool, ground first and truck last as startLevel would have made them
+    BodyPool &pool = sim.pool;
+    for (b2Body *body : pool.cargo) sim.world.DestroyBody(body);
+    if (pool.ground.body) sim.world.DestroyBody(pool.ground.body);
+    if (pool.truck.body) sim.world.DestroyBody(pool.truck.body);
+    pool = BodyPool{};
+    sim.world.SetGravity(b2Vec2(header.gravity[0], header.gravity[1]));
+    next_vertex = 0;
+    for (std::uint32_t i = 0; i < header.body_count; i++) {
+        const WorldBody &saved = bodies[i];
+        b2Body *body = createBody(sim.world, saved, vertices + next_vertex);
+        next_vertex += saved.vertex_count;
+        body->GetUserData().pointer = i;
+        sim.boxes.push_back(Box{saved.width, saved.height, art.*body_sprites[saved.sprite], body});
+        if (i > 0 && i + 1 < header.body_count) pool.cargo.push_back(body);
+    }
+    pool.ground = sim.boxes.front();
+    pool.truck = sim.boxes.back();
+
+    level = header.level;
+    sim.level = &levels[level];
+    sim.n_boxes = header.n_boxes;
+    sim.total = header.total;
+    sim.sambar_top = Sambar{.x = header.top[0], .y = header.top[1], .rotation = header.top[2], .sprite = art.sambar_top};
+
+    // Bring back the contacts' impulses and whether the ground was struck, and keep it all to retry from
+    captureWorld(sim.retry_point, sim);
+    sim.retry_point.contacts.assign(contacts, contacts + header.contact_count);
+    sim.retry_point.struck = header.struck;
+    if (!restoreWorld(sim, sim.retry_point)) return false;
+    sim.resting = 0;
+    sim.settled = true;
+    rememberPoses(sim);
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef SAMBAR_WORLD_FILE_H
+#define SAMBAR_WORLD_FILE_H
+
+#include "game.h"
+#include <string>
+#include <vector>
+
+// World files hold a level in progress exactly, for bug reports and for benchmarks that start from
+// a known scene. They are little endian and 4-byte aligned:
+//   "SWLD", u32 version, u32 level, u32 box count, i32 total, u32 body count, u32 vertex count,
+//   u32 contact count, f32 gravity x, y, f32 top-down sambar x, y, rotation, u32 struck,
+//   then per body, in the order of Simulation::boxes: u32 type, u32 sprite, u32 flags,
+//   f32 width, height, x, y, angle, linear velocity x, y, angular velocity, linear damping,
+//   angular damping, gravity scale, and its one polygon fixture: u32 fixture kind, u32 vertex count,
+//   f32 density, friction, restitution, restitution threshold, radius, centroid x, y,
+//   then f32 x, y, normal x, normal y for every vertex of every body,
+//   then the warm-start impulses of every touching contact as a ContactState
+// Only worlds whose bodies each have a single polygon fixture can be saved, as every world the
+// game builds does
+bool saveWorld(const std::string &path, const Simulation &sim, const Artwork &art, int level);
+// Recreate a saved world in sim, which must have no level running. Its bodies join sim's pool, so
+// later levels run as usual. Retries go back to the loaded state
+bool loadWorld(const std::string &path, Simulation &sim, std::vector<Level> &levels, Artwork &art, int &level);
+
+#endif
@@ -0,0 +1,109 @@
+#include "world_snapshot.h"
+#include "game.h"
+#include <utility>
+
+// Index into boxes of the body a contact fixture belongs to
+static std::uint32_t boxIndex(const b2Fixture *fixture) {
+    return static_cast<std::uint32_t>(fixture->GetBody()->GetUserData().pointer);
+}
+
+void captureWorld(WorldSnapshot &snapshot, const Simulation &sim) {
+    snapshot.bodies.clear();
+    for (const auto &box : sim.boxes) {
+        const b2Body *body = box.body;
+        snapshot.bodies.push_back(BodyState{body->GetPosition(), body->GetAngle(), body->GetLinearVelocity(),
+                                            body->GetAngularVelocity(), body->IsAwake()});
+    }
+
+    // Contacts that aren't touching carry no impulses worth keeping
+    snapshot.contacts.clear();
+    for (const b2Contact *contact = sim.world.GetContactList(); contact; contact = contact->GetNext()) {
+        const b2Manifold *manifold = contact->GetManifold();
+        if (!contact->IsTouching() || manifold->pointCount == 0) continue;
+        ContactState state{};
+        state.body_a = boxIndex(contact->GetFixtureA());
+        state.body_b = boxIndex(contact->GetFixtureB());
+        state.point_count = manifold->pointCount;
+        for (int i = 0; i < manifold->pointCount; i++) {
+            state.ids[i] = manifold->points[i].id.key;
+            state.normal_impulses[i] = manifold->points[i].normalImpulse;
+            state.tangent_impulses[i] = manifold->points[i].tangentImpulse;
+        }
+        snapshot.contacts.push_back(state);
+    }
+
+    snapshot.top_x = sim.sambar_top.x;
+    snapshot.top_y = sim.sambar_top.y;
+    snapshot.top_rotation = sim.sambar_top.rotation;
+    snapshot.struck = sim.ground.struck;
+}
+
+// The id a manifold point gets when the same two fixtures meet the other way round
+static std::uint32_t swapFeatures(std::uint32_t key) {
+    b2ContactID id;
+    id.key = key;
+    std::swap(id.cf.indexA, id.cf.indexB);
+    std::swap(id.cf.typeA, id.cf.typeB);
+    return id.key;
+}
+
+// Warm-start a contact from the saved one between the same bodies, or from nothing if there was
+// none. The broad-phase may pair the fixtures the other way round from when it was saved, which
+// swaps the features and turns the tangent around
+static void restoreImpulses(b2Contact *contact, const WorldSnapshot &snapshot) {
+    std::uint32_t a = boxIndex(contact->GetFixtureA());
+    std::uint32_t b = boxIndex(contact->GetFixtureB());
+    const ContactState *saved = nullptr;
+    bool swapped = false;
+    for (const auto &state : snapshot.contacts) {
+        if ((state.body_a == a && state.body_b == b) || (state.body_a == b && state.body_b == a)) {
+            saved = &state;
+            swapped = state.body_a != a;
+            break;
+        }
+    }
+
+    b2Manifold *manifold = contact->GetManifold();
+    for (int i = 0; i < manifold->pointCount; i++) {
+        b2ManifoldPoint &point = manifold->points[i];
+        point.normalImpulse = 0.f;
+        point.tangentImpulse = 0.f;
+        for (int j = 0; saved && j < saved->point_count; j++) {
+            if ((swapped ? swapFeatures(saved->ids[j]) : saved->ids[j]) == point.id.key) {
+                point.normalImpulse = saved->normal_impulses[j];
+                point.tangentImpulse = swapped ? -saved->tangent_impulses[j] : saved->tangent_impulses[j];
+            }
+        }
+    }
+}
+
+bool restoreWorld(Simulation &sim, const WorldSnapshot &snapshot) {
+    if (snapshot.bodies.size() != sim.boxes.size()) return false;
+
+    for (std::size_t i = 0; i < sim.boxes.size(); i++) {
+        b2Body *body = sim.boxes[i].body;
+        const BodyState &state = snapshot.bodies[i];
+        body->SetTransform(state.position, state.angle);
+        // Sleeping also clears velocities and forces, and a sleeping body has none to set
+        body->SetAwake(false);
+        if (state.awake) {
+            body->SetAwake(true);
+            body->SetLinearVelocity(state.linear_velocity);
+            body->SetAngularVelocity(state.angular_velocity);
+        }
+    }
+
+    // A step of no time finds and collides the contacts at the restored poses without solving
+    // anything, so their manifolds are there to put the saved impulses into
+    sim.world.Step(0.f, 0, 0);
+    for (b2Contact *contact = sim.world.GetContactList(); contact; contact = contact->GetNext()) {
+        restoreImpulses(contact, snapshot);
+    }
+
+    sim.sambar_top.x = snapshot.top_x;
+    sim.sambar_top.y = snapshot.top_y;
+    sim.sambar_top.rotation = snapshot.top_rotation;
+    // The step above reports contacts to the listener too, so its state goes back last
+    sim.ground.struck = snapshot.struck;
+    return true;
+}
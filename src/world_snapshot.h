@@ -0,0 +1,50 @@
+#ifndef SAMBAR_WORLD_SNAPSHOT_H
+#define SAMBAR_WORLD_SNAPSHOT_H
+
+#include <box2d/box2d.h>
+#include <cstdint>
+#include <vector>
+
+struct Simulation;
+
+// Where one body of Simulation::boxes is and how it moves
+struct BodyState
+{
+    b2Vec2 position;
+    float angle;
+    b2Vec2 linear_velocity;
+    float angular_velocity;
+    bool awake;
+};
+
+// The impulses the solver found for one touching contact, to warm-start it from
+struct ContactState
+{
+    // Indices into Simulation::boxes, in the contact's fixture order
+    std::uint32_t body_a;
+    std::uint32_t body_b;
+    int point_count;
+    std::uint32_t ids[b2_maxManifoldPoints];
+    float normal_impulses[b2_maxManifoldPoints];
+    float tangent_impulses[b2_maxManifoldPoints];
+};
+
+// A level in progress, kept in flat arrays so capturing one doesn't allocate once they have grown.
+// It can only be restored into the same level with the same stack
+struct WorldSnapshot
+{
+    std::vector<BodyState> bodies;
+    std::vector<ContactState> contacts;
+    float top_x = 0.f;
+    float top_y = 0.f;
+    float top_rotation = 0.f;
+    bool struck = false;
+};
+
+void captureWorld(WorldSnapshot &snapshot, const Simulation &sim);
+// Put sim back as it was when captured. If it has a different set of bodies, return false without
+// changing anything. Box2D doesn't expose how long a body has been still, so bodies that were
+// awake start that count over
+bool restoreWorld(Simulation &sim, const WorldSnapshot &snapshot);
+
+#endif